@@ -0,0 +1,90 @@
+/*
+ *  This file is part of libdwarf++.
+ *
+ *  Copyright © 2015 Frankin "Snaipe" Mathieu <http://snaipe.me>
+ *
+ *  libdwarf++ is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libdwarf++ is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libdwarf++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LIBDWARFPP_ADDRINDEX_HH
+# define LIBDWARFPP_ADDRINDEX_HH
+
+# include <cstdint>
+# include <vector>
+# include <memory>
+# include "dwarf.hh"
+# include "span.hh"
+
+namespace Dwarf {
+
+    /*
+     * Sorted, non-overlapping address intervals built once from the pc
+     * ranges of compilation units, subprograms and inlined subroutines.
+     * Nested ranges are flattened so that every interval maps to the
+     * innermost DIE covering it, and a lookup is a single binary search.
+     */
+    class AddressIndex final {
+    public:
+        struct Entry {
+            Dwarf::Off die;
+            Dwarf::Half tag;
+            uint32_t cu;            // index in Debug::cu()
+        };
+
+        struct Segment {
+            Dwarf::Addr lo;
+            Dwarf::Addr hi;         // exclusive
+            uint32_t entry;
+        };
+
+        explicit AddressIndex(const Debug& dbg);
+
+        /* Index over tables stored elsewhere, e.g. in an index file, which
+         * owner keeps alive. */
+        AddressIndex(const Debug& dbg, Span<const Entry> entries, Span<const Segment> scopes,
+                     Span<const Segment> units, std::shared_ptr<const void> owner);
+
+        /* Innermost subprogram, inlined subroutine or unit covering pc. */
+        const Entry* find(Dwarf::Addr pc) const;
+
+        /* Unit covering pc. */
+        const Entry* find_cu(Dwarf::Addr pc) const;
+
+        std::shared_ptr<AnyDie> lookup_pc(Dwarf::Addr pc) const;
+        const CompilationUnit* lookup_cu(Dwarf::Addr pc) const;
+
+        /* Whether the tables are consistent with each other and with a
+         * Debug of cu_count units; tables read from a file are checked
+         * before use. */
+        bool valid(size_t cu_count) const;
+
+        Span<const Entry> entries() const      { return entries_; }
+        Span<const Segment> scopes() const     { return scopes_; }
+        Span<const Segment> units() const      { return units_; }
+
+    private:
+        struct Tables;
+
+        const Entry* find(Span<const Segment> segs, Dwarf::Addr pc) const;
+
+        std::weak_ptr<const Debug> dbg_;
+        Span<const Entry> entries_;
+        Span<const Segment> scopes_;
+        Span<const Segment> units_;
+        std::shared_ptr<const void> owner_;
+    };
+
+}
+
+#endif /* !LIBDWARFPP_ADDRINDEX_HH */
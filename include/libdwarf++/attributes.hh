@@ -0,0 +1,256 @@
+/*
+ *  This file is part of libdwarf++.
+ *
+ *  Copyright © 2015 Frankin "Snaipe" Mathieu <http://snaipe.me>
+ *
+ *  libdwarf++ is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libdwarf++ is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libdwarf++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LIBDWARFPP_ATTRIBUTES_HH
+# define LIBDWARFPP_ATTRIBUTES_HH
+
+# include <array>
+# include <cstdint>
+# include <cstring>
+# include <stdexcept>
+# include <string>
+# include <type_traits>
+# include <boost/container/small_vector.hpp>
+# include <boost/utility/string_view.hpp>
+# include "cdwarf"
+# include "span.hh"
+
+namespace Dwarf {
+
+    class Debug;
+
+    /*
+     * Typed value of an attribute, decoded by form class. The value is
+     * trivially copyable: strings, blocks and expressions are views over
+     * the section bytes owned by the Debug, so reading them allocates
+     * nothing and nothing has to be deallocated afterwards.
+     */
+    class AttributeValue {
+    public:
+        enum Kind : uint8_t {
+            NONE = 0,
+            UNSIGNED,
+            SIGNED,
+            ADDRESS,
+            REFERENCE,          // global .debug_info offset
+            SECTION_OFFSET,     // offset into another section (loclist, ranges, ...)
+            FLAG,
+            STRING,
+            BLOCK,
+            EXPRLOC,
+            SIGNATURE,          // 8-byte type signature (DW_FORM_ref_sig8)
+            INDEX,              // index into the unit's range or location list table
+            DATA16,             // 16-byte constant (DW_FORM_data16), held inline
+            UNSUPPORTED,        // present, but in a form that is not decoded
+        };
+
+        AttributeValue() : kind_(NONE) {
+            u_.u = 0;
+        }
+
+        static AttributeValue make_unsigned(Dwarf::Unsigned v)   { AttributeValue a(UNSIGNED);       a.u_.u = v; return a; }
+        static AttributeValue make_signed(Dwarf::Signed v)       { AttributeValue a(SIGNED);         a.u_.s = v; return a; }
+        static AttributeValue make_address(Dwarf::Addr v)        { AttributeValue a(ADDRESS);        a.u_.u = v; return a; }
+        static AttributeValue make_reference(Dwarf::Off v)       { AttributeValue a(REFERENCE);      a.u_.u = v; return a; }
+        static AttributeValue make_section_offset(Dwarf::Off v)  { AttributeValue a(SECTION_OFFSET); a.u_.u = v; return a; }
+        static AttributeValue make_flag(bool v)                  { AttributeValue a(FLAG);           a.u_.u = v; return a; }
+        static AttributeValue make_signature(uint64_t v)         { AttributeValue a(SIGNATURE);      a.u_.u = v; return a; }
+        static AttributeValue make_index(Dwarf::Unsigned v)      { AttributeValue a(INDEX);          a.u_.u = v; return a; }
+        static AttributeValue make_unsupported(Dwarf::Half form) { AttributeValue a(UNSUPPORTED);    a.u_.u = form; return a; }
+
+        static AttributeValue make_data16(const void* data) {
+            AttributeValue a(DATA16);
+            std::memcpy(a.u_.data16, data, sizeof (a.u_.data16));
+            return a;
+        }
+
+        static AttributeValue make_string(const char* str) {
+            AttributeValue a(STRING);
+            a.u_.bytes.data = reinterpret_cast<const Dwarf::Small*>(str);
+            a.u_.bytes.size = str ? std::strlen(str) : 0;
+            return a;
+        }
+
+        static AttributeValue make_bytes(Kind kind, const void* data, size_t size) {
+            AttributeValue a(kind);
+            a.u_.bytes.data = static_cast<const Dwarf::Small*>(data);
+            a.u_.bytes.size = size;
+            return a;
+        }
+
+        Kind kind() const { return kind_; }
+
+        explicit operator bool() const {
+            return kind_ != NONE;
+        }
+
+        /* Constants have no intrinsic signedness: both accessors accept
+         * either constant kind and reinterpret the bits. */
+        Dwarf::Unsigned as_unsigned() const {
+            expect(kind_ == UNSIGNED || kind_ == SIGNED);
+            return u_.u;
+        }
+
+        Dwarf::Signed as_signed() const {
+            expect(kind_ == UNSIGNED || kind_ == SIGNED);
+            return u_.s;
+        }
+
+        Dwarf::Addr as_address() const {
+            expect(kind_ == ADDRESS);
+            return u_.u;
+        }
+
+        Dwarf::Off as_reference() const {
+            expect(kind_ == REFERENCE);
+            return u_.u;
+        }
+
+        Dwarf::Off as_section_offset() const {
+            expect(kind_ == SECTION_OFFSET);
+            return u_.u;
+        }
+
+        bool as_flag() const {
+            expect(kind_ == FLAG);
+            return u_.u != 0;
+        }
+
+        /* The signature bytes in section order, loaded as a host integer. */
+        uint64_t as_signature() const {
+            expect(kind_ == SIGNATURE);
+            return u_.u;
+        }
+
+        /* DW_FORM_rnglistx or DW_FORM_loclistx index. */
+        Dwarf::Unsigned as_index() const {
+            expect(kind_ == INDEX);
+            return u_.u;
+        }
+
+        /* Copied out: unlike blocks, the bytes live in the value itself. */
+        std::array<Dwarf::Small, 16> as_data16() const {
+            expect(kind_ == DATA16);
+            std::array<Dwarf::Small, 16> bytes;
+            std::memcpy(bytes.data(), u_.data16, bytes.size());
+            return bytes;
+        }
+
+        /* Form of an UNSUPPORTED value. */
+        Dwarf::Half unsupported_form() const {
+            expect(kind_ == UNSUPPORTED);
+            return static_cast<Dwarf::Half>(u_.u);
+        }
+
+        boost::string_view as_string() const {
+            expect(kind_ == STRING);
+            return boost::string_view(reinterpret_cast<const char*>(u_.bytes.data), u_.bytes.size);
+        }
+
+        /* NUL-terminated, since strings point straight into the section. */
+        const char* as_cstring() const {
+            expect(kind_ == STRING);
+            return reinterpret_cast<const char*>(u_.bytes.data);
+        }
+
+        Span<const Dwarf::Small> as_block() const {
+            expect(kind_ == BLOCK);
+            return Span<const Dwarf::Small>(u_.bytes.data, u_.bytes.size);
+        }
+
+        Span<const Dwarf::Small> as_exprloc() const {
+            expect(kind_ == EXPRLOC);
+            return Span<const Dwarf::Small>(u_.bytes.data, u_.bytes.size);
+        }
+
+    private:
+        explicit AttributeValue(Kind kind) : kind_(kind) {
+            u_.bytes.data = nullptr;
+            u_.bytes.size = 0;
+        }
+
+        void expect(bool ok) const {
+            if (ok)
+                return;
+            if (kind_ == UNSUPPORTED)
+                throw std::runtime_error("Unsupported attribute form " + std::to_string(u_.u));
+            throw std::runtime_error("Unexpected attribute value kind");
+        }
+
+        Kind kind_;
+        union {
+            Dwarf::Unsigned u;
+            Dwarf::Signed s;
+            struct {
+                const Dwarf::Small* data;
+                size_t size;
+            } bytes;
+            Dwarf::Small data16[16];
+        } u_;
+    };
+
+    static_assert(std::is_trivially_copyable<AttributeValue>::value,
+                  "AttributeValue must stay trivially copyable");
+
+    struct AttributeEntry {
+        Dwarf::Half name;
+        Dwarf::Half form;
+        AttributeValue value;
+    };
+
+    /*
+     * All attributes of a DIE, fetched with a single dwarf_attrlist call and
+     * decoded up front. Most DIEs have only a handful of attributes, which
+     * fit in the inline buffer. An attribute libdwarf fails to decode is
+     * left out rather than failing the whole list.
+     */
+    class AttributeList {
+    public:
+        AttributeList() : loaded_(false) {}
+
+        void load(const Debug& dbg, dwarf::Dwarf_Die die);
+
+        bool loaded() const {
+            return loaded_;
+        }
+
+        const AttributeEntry* get(Dwarf::Half name) const {
+            for (const AttributeEntry& e : entries_)
+                if (e.name == name)
+                    return &e;
+            return nullptr;
+        }
+
+        bool has(Dwarf::Half name) const {
+            return get(name) != nullptr;
+        }
+
+        size_t size() const { return entries_.size(); }
+
+        const AttributeEntry* begin() const { return entries_.data(); }
+        const AttributeEntry* end() const   { return entries_.data() + entries_.size(); }
+
+    private:
+        boost::container::small_vector<AttributeEntry, 6> entries_;
+        bool loaded_;
+    };
+
+}
+
+#endif /* !LIBDWARFPP_ATTRIBUTES_HH */
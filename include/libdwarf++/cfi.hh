@@ -0,0 +1,178 @@
+/*
+ *  This file is part of libdwarf++.
+ *
+ *  Copyright © 2015 Frankin "Snaipe" Mathieu <http://snaipe.me>
+ *
+ *  libdwarf++ is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libdwarf++ is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libdwarf++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LIBDWARFPP_CFI_HH
+# define LIBDWARFPP_CFI_HH
+
+# include <cstdint>
+# include <functional>
+# include <memory>
+# include <vector>
+# include "cdwarf"
+# include "expression.hh"
+# include "span.hh"
+
+namespace Dwarf {
+
+    class Debug;
+
+    /*
+     * Register state of the frame being unwound, indexed by DWARF register
+     * number.
+     */
+    struct Registers {
+        static constexpr size_t count = 128;
+        static constexpr Dwarf::Half none = 0xffff;
+
+        Registers() : values(), pc(0), cfa(0), sp(none), return_address(false) {}
+
+        uint64_t values[count];
+        Dwarf::Addr pc;
+        Dwarf::Addr cfa;            // set by each unwind step
+        Dwarf::Half sp;             // register that takes the CFA on each step, if any
+        bool return_address;        // pc is a return address, look rows up at pc - 1
+    };
+
+    /*
+     * Call frame information from .debug_frame and .eh_frame. FDEs are
+     * indexed by address when this is built; the CFA program of an FDE is
+     * run into a table of unwind rows the first time a pc inside it is
+     * looked up, and the table is kept for later lookups.
+     */
+    class CallFrameInfo final {
+    public:
+        struct Rule {
+            enum Kind : uint8_t {
+                UNDEFINED,
+                SAME_VALUE,
+                OFFSET,             // saved at CFA + value
+                VAL_OFFSET,         // value is CFA + value
+                REGISTER,           // saved in register value
+                EXPRESSION,         // saved at the address computed by expression value
+                VAL_EXPRESSION,     // value is computed by expression value
+            };
+
+            Kind kind;
+            int64_t value;
+        };
+
+        struct RegisterRule {
+            Dwarf::Half reg;
+            Rule rule;
+        };
+
+        /* CFA is reg + offset, or the result of an expression. */
+        struct CFARule {
+            static constexpr uint32_t no_expr = UINT32_MAX;
+
+            Dwarf::Half reg;
+            int64_t offset;
+            uint32_t expr;
+        };
+
+        struct Row {
+            Dwarf::Addr lo;
+            Dwarf::Addr hi;         // exclusive
+            CFARule cfa;
+            uint32_t first_rule;    // rules of the row, in Table::rules
+            uint32_t rule_count;
+        };
+
+        struct CIE {
+            uint64_t code_align;
+            int64_t data_align;
+            Dwarf::Half return_address;
+            bool signal_frame;      // 'S' augmentation: frames interrupted by a signal
+            Span<const Dwarf::Small> initial_instructions;
+        };
+
+        struct FDE {
+            Dwarf::Addr lo;
+            Dwarf::Addr hi;         // exclusive
+            Span<const Dwarf::Small> instructions;
+            uint32_t cie;
+        };
+
+        /* Unwind rows of one FDE. Rows share their rules when unchanged. */
+        struct Table {
+            std::vector<Row> rows;
+            std::vector<RegisterRule> rules;
+            std::vector<Expression> exprs;
+            Dwarf::Half return_address;
+            bool signal_frame;
+
+            const Row* find(Dwarf::Addr pc) const;
+
+            Span<const RegisterRule> rules_of(const Row& row) const {
+                return Span<const RegisterRule>(rules.data() + row.first_rule, row.rule_count);
+            }
+
+        private:
+            friend class CallFrameInfo;
+            std::vector<std::vector<Dwarf::Small>> code_;
+        };
+
+        using MemoryReader = std::function<uint64_t(uint64_t addr, size_t size)>;
+
+        explicit CallFrameInfo(const Debug& dbg);
+
+        /* FDE covering pc, or nullptr. O(log n). */
+        const FDE* find_fde(Dwarf::Addr pc) const;
+
+        /* Unwind table of the FDE covering pc, built on first use. */
+        const Table* table(Dwarf::Addr pc) const;
+
+        /* Unwind row in effect at pc, or nullptr. */
+        const Row* find_row(Dwarf::Addr pc) const;
+
+        /*
+         * Replaces regs with the state of the caller's frame. All memory,
+         * for register rules and DWARF expressions alike, is read through
+         * read_memory, which is required: the registers may come from
+         * another process or a recorded sample. Returns false when there
+         * is no caller: no CFI covers the pc, or the return address is
+         * undefined. Past a signal frame, the pc is the interrupted
+         * instruction rather than a return address.
+         */
+        bool unwind_step(Registers& regs, const MemoryReader& read_memory) const;
+
+        const std::vector<FDE>& fdes() const {
+            return fdes_;
+        }
+
+        const std::vector<CIE>& cies() const {
+            return cies_;
+        }
+
+    private:
+        using ListFunction = int (*)(dwarf::Dwarf_Debug, dwarf::Dwarf_Cie**, Dwarf::Signed*,
+                                     dwarf::Dwarf_Fde**, Dwarf::Signed*, dwarf::Dwarf_Error*);
+
+        void load(const Debug& dbg, ListFunction list);
+        std::unique_ptr<const Table> build(const FDE& fde) const;
+
+        Dwarf::Half address_size_;
+        std::vector<CIE> cies_;
+        std::vector<FDE> fdes_;
+        mutable std::vector<std::unique_ptr<const Table>> tables_;
+    };
+
+}
+
+#endif /* !LIBDWARFPP_CFI_HH */
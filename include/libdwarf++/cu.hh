@@ -23,9 +23,24 @@
 # include <iterator>
 # include "dwarf.hh"
 # include "die.hh"
+# include "dietable.hh"
+# include "linetable.hh"
 
 namespace Dwarf {
 
+    struct CUHeader {
+        Dwarf::Off offset;          // offset of the unit header in .debug_info
+        Unsigned length;            // size of the unit, header included
+        Half version;
+        Unsigned abbrev_offset;
+        Half address_size;
+        Dwarf::Off die_offset;      // offset of the unit DIE
+
+        Dwarf::Off end() const {
+            return offset + length;
+        }
+    };
+
     class CompilationUnit {
     public:
         CompilationUnit(std::weak_ptr<const Debug> dbg,
@@ -36,19 +51,52 @@ namespace Dwarf {
                         Half address_size = 0,
                         Unsigned header = 0);
 
+        CompilationUnit(std::weak_ptr<const Debug> dbg,
+                        std::shared_ptr<AnyDie> die,
+                        const CUHeader& header);
+
         bool operator==(const CompilationUnit &other) const;
         bool operator!=(const CompilationUnit &other) const;
         operator bool() const;
         Die& get_die() const;
 
+        /* Base address of the unit (DW_AT_low_pc), 0 if it has none. */
+        Dwarf::Addr base_address() const;
+
+        /*
+         * For a skeleton unit (-gsplit-dwarf), the unit holding its DIEs,
+         * from the matching .dwo or .dwp, opened on first call. nullptr for
+         * other units or if the split unit cannot be found.
+         */
+        const CompilationUnit* split_unit() const;
+
+        /* The split unit if there is one, this unit otherwise. */
+        const CompilationUnit& unit() const {
+            const CompilationUnit* split = split_unit();
+            return split ? *split : *this;
+        }
+
+        /* Preorder range over the unit DIE and all of its descendants;
+         * skeleton units are walked through their split unit. */
+        DieRange dies() const;
+
+        /*
+         * Opt-in flat view of the whole unit, decoded on first use and
+         * shared by subsequent calls. Like dies(), follows split units.
+         */
+        const DieTable& die_table() const;
+
+        /* Line program of the unit, decoded on first use. */
+        const LineTable& line_table() const;
+
         template <typename T>
         void visit(T& visitor) const {
-            Die::visit_die(visitor, *die_);
+            Die::visit_die(visitor, *unit().die_);
         }
 
         template <typename T>
         void visit_headless(T& visitor) const {
-            get_die().visit_headless(visitor);
+            unit().get_die().visit_headless(visitor);
         }
 
     private:
@@ -59,31 +107,35 @@ namespace Dwarf {
         Unsigned abbrev_offset_;
         Half address_size_;
         Unsigned header_;
+        mutable std::shared_ptr<const DieTable> table_;
+        mutable std::shared_ptr<const LineTable> lines_;
+        mutable bool split_resolved_ = false;
+        mutable const CompilationUnit* split_ = nullptr;
     };
 
     class Debug;
 
+    /* Position in the unit table of a Debug; see Debug::cu(). */
     class CUIterator : public std::iterator<std::forward_iterator_tag, const CompilationUnit> {
     public:
-        CUIterator(std::shared_ptr<const Debug>& dbg, std::shared_ptr<CompilationUnit>& value) throw (Exception);
-        CUIterator(const CUIterator& other);
+        static constexpr size_t npos = static_cast<size_t>(-1);
+
+        CUIterator(std::shared_ptr<const Debug> dbg, size_t index);
 
         const CompilationUnit& operator*() const;
+        const CompilationUnit* operator->() const;
         bool operator==(const CUIterator &other) const;
         bool operator!=(const CUIterator &other) const;
-        CUIterator& operator=(const CUIterator& cu);
         CUIterator& operator++();
+        CUIterator operator++(int);
 
-        static std::unique_ptr<CUIterator> next(std::shared_ptr<const Debug> dbg);
-        static std::unique_ptr<CUIterator> end(std::shared_ptr<const Debug> dbg);
+        size_t index() const {
+            return index_;
+        }
 
     private:
-        static std::shared_ptr<CompilationUnit> next_cu(std::shared_ptr<const Debug> dbg);
-
         std::weak_ptr<const Debug> dbg_;
-        bool end_;
-        std::shared_ptr<std::unique_ptr<CUIterator>> next_;
-        std::shared_ptr<CompilationUnit> value_;
+        size_t index_;
     };
 };
 
@@ -1,11 +1,17 @@
 #ifndef LIBDWARFPP_DIE_HH
 # define LIBDWARFPP_DIE_HH
 
+# include <cstring>
 # include <functional>
+# include <iterator>
 # include <memory>
+# include <vector>
 # include "dwarf.hh"
+# include "attributes.hh"
 # include "tag.hh"
+# include "dispatch.hh"
 # include "exprloc.hh"
+# include "loclist.hh"
 
 # include "anydie.hh"
 
@@ -68,9 +74,16 @@ namespace Dwarf {
                 case DW_FORM_ref2:
                 case DW_FORM_ref4:
                 case DW_FORM_ref8:
-                case DW_FORM_ref_sig8:
                 case DW_FORM_ref_udata:
                 case DW_FORM_ref_addr:  callres = dwarf::dwarf_global_formref(attr_, &result, &err); break;
+                case DW_FORM_ref_sig8: {
+                    dwarf::Dwarf_Sig8 sig;
+                    uint64_t signature;
+                    if (dwarf::dwarf_formsig8(attr_, &sig, &err) == DW_DLV_ERROR)
+                        throw Exception(dbg_, err);
+                    std::memcpy(&signature, sig.signature, sizeof (signature));
+                    return dbg->signature_die(signature);
+                }
                 default:
                     throw std::runtime_error("Unexpected non-reference attribute");
             }
@@ -80,6 +93,10 @@ namespace Dwarf {
             return dbg->offdie(result);
         }
 
+        const dwarf::Dwarf_Attribute& get_handle() const {
+            return attr_;
+        }
+
     private:
         std::weak_ptr<const Debug> dbg_;
         dwarf::Dwarf_Attribute attr_;
@@ -89,7 +106,7 @@ namespace Dwarf {
 
     struct DieData {
 
-        DieData(std::weak_ptr<const Debug> dbg, dwarf::Dwarf_Die& die);
+        DieData(std::weak_ptr<const Debug> dbg, dwarf::Dwarf_Die& die, Dwarf::Half tag);
         ~DieData();
 
         std::weak_ptr<const Debug> dbg_;
@@ -97,8 +114,14 @@ namespace Dwarf {
         std::shared_ptr<AnyDie> sibling, child;
         char *name;
         Dwarf::Off offset;
+        Dwarf::Half tag;
+        AttributeList attributes;
+        std::shared_ptr<const LocationList> locations;
+        Dwarf::Half locations_attr;
     };
 
+    class DieRange;
+
     class Die {
     public:
         enum TraversalResult {
@@ -110,6 +133,7 @@ namespace Dwarf {
         using TraversalFunction = std::function<TraversalResult(Die&, void*)>;
 
         Die(std::weak_ptr<const Debug> dbg, dwarf::Dwarf_Die& die);
+        Die(std::weak_ptr<const Debug> dbg, dwarf::Dwarf_Die& die, Dwarf::Half tag);
         ~Die();
 
         virtual void traverse(TraversalFunction func, void* data);
@@ -117,6 +141,9 @@ namespace Dwarf {
         virtual Die& sibling();
         virtual Die& child();
 
+        /* Immediate children of this DIE, in order. */
+        DieRange children();
+
         struct visitor_to_die : public boost::static_visitor<Die&> {
             template <typename T>
             Die& operator()(T& ptr) {
@@ -130,7 +157,34 @@ namespace Dwarf {
         template <typename T>
         void visit_headless(T& visitor);
 
+        /*
+         * Calls visitor(TaggedDie<Tag>&) for the tag of this DIE, or
+         * visitor(Die&) for tags without a TaggedDie, with a table jump
+         * instead of a variant visit.
+         */
+        template <typename T>
+        typename T::result_type dispatch(T& visitor);
+
+        /* Same, for a raw DIE; the Die built for it takes ownership of die. */
+        template <typename T>
+        static typename T::result_type dispatch(T& visitor, std::weak_ptr<const Debug> dbg, dwarf::Dwarf_Die die);
+
+        /*
+         * Preorder traversal like visit_die, dispatching on the tag. DIEs
+         * are read straight from libdwarf and handed to the visitor as
+         * TaggedDie objects built on the stack: no AnyDie is created and
+         * none of the visited DIEs are linked into one another.
+         */
+        template <typename T>
+        static void dispatch_die(T& visitor, Die& die);
+
+        /* Tags are read when the DIE is built; neither calls libdwarf. */
         const Tag get_tag() const throw(Exception);
+
+        Dwarf::Half tag_id() const {
+            return data_->tag;
+        }
+
         const char* get_name() const throw(Exception);
 
         const dwarf::Dwarf_Die& get_handle() const {
@@ -141,6 +195,27 @@ namespace Dwarf {
 
         std::unique_ptr<const Attribute> get_attribute(Dwarf::Half attr) const;
 
+        /*
+         * Every attribute of the DIE, fetched and decoded once on first use.
+         * Later lookups neither allocate nor call into libdwarf.
+         */
+        const AttributeList& attributes() const;
+
+        /* Decoded value of attr, or an empty value if the DIE lacks it. */
+        AttributeValue get_value(Dwarf::Half attr) const {
+            const AttributeEntry* e = attributes().get(attr);
+            return e ? e->value : AttributeValue();
+        }
+
+        /* DIE referenced by attr, or nullptr if the DIE has no such attribute. */
+        std::shared_ptr<AnyDie> get_reference(Dwarf::Half attr) const;
+
+        /*
+         * Location list of attr, e.g. DW_AT_location or DW_AT_frame_base,
+         * decoded once and kept with the DIE. nullptr if the DIE lacks it.
+         */
+        std::shared_ptr<const LocationList> get_location_list(Dwarf::Half attr = DW_AT_location) const;
+
         std::shared_ptr<const Debug> get_debug() const {
             return dbg_.lock();
         }
@@ -166,11 +241,26 @@ namespace Dwarf {
         Die& operator=(Die&& other) = default;
 
     protected:
+        friend class DieIterator;
+        friend class DieCache;
+        friend struct DieData;
+
         Die();
 
         void init_sibling();
         void init_child();
 
+        /* Preorder walk from start, its subtree and its following siblings,
+         * with a Die built for each DIE; see dispatch_die. */
+        using WalkFunction = TraversalResult (*)(void* context, Die& die);
+        static void walk(Die& start, WalkFunction func, void* context);
+
+        /* The cached link if there is one, otherwise a fresh DIE that is not
+         * stored in this one. leaf lets a DIE known to have no children skip
+         * the subtree lookup. */
+        std::shared_ptr<AnyDie> load_sibling(bool leaf) const;
+        std::shared_ptr<AnyDie> load_child() const;
+
         std::weak_ptr<const Debug> dbg_;
         std::shared_ptr<DieData> data_;
     };
@@ -188,7 +278,12 @@ namespace Dwarf {
     class TaggedDie : public Die {
     public:
         TaggedDie(std::weak_ptr<const Debug> dbg, dwarf::Dwarf_Die &die)
-                : Die(dbg, die)
+                : Die(dbg, die, TagId)
+        {}
+
+        /* Another handle to die, which must have the tag TagId. */
+        explicit TaggedDie(const Die& die)
+                : Die(die)
         {}
     };
 
@@ -199,26 +294,101 @@ namespace Dwarf {
         }
     };
 
+    /*
+     * Preorder iterator over a DIE tree, driven by an explicit stack of
+     * ancestors rather than recursion: the native stack depth is constant
+     * and the heap usage grows with the tree depth only.
+     *
+     * The DIEs it steps through are not linked into their predecessors;
+     * the iterator holds the current DIE and its ancestors, and a DIE it
+     * has moved past is released unless the caller kept a copy.
+     */
+    class DieIterator : public std::iterator<std::forward_iterator_tag, Die> {
+    public:
+        DieIterator();
+        DieIterator(Die* start, AnyDie* start_any, bool siblings, bool descend);
+
+        Die& operator*() const  { return *cur_; }
+        Die* operator->() const { return cur_; }
+
+        /* The variant holding the current DIE, or nullptr for a start DIE
+         * that was not handed over as an AnyDie. */
+        AnyDie* any() const     { return any_; }
+
+        /* Depth of the current DIE relative to the first one. */
+        size_t depth() const    { return stack_.size(); }
+
+        /* Do not descend into the current DIE on the next increment. Its
+         * subtree is jumped over, not decoded; see Debug::next_sibling_offset. */
+        void skip_children()    { skip_ = true; }
+
+        DieIterator& operator++();
+
+        bool operator==(const DieIterator& other) const { return cur_ == other.cur_; }
+        bool operator!=(const DieIterator& other) const { return cur_ != other.cur_; }
+
+    private:
+        struct Frame {
+            Die* die;
+            std::shared_ptr<AnyDie> owner;
+        };
+
+        void set(std::shared_ptr<AnyDie> die);
+
+        std::vector<Frame> stack_;
+        Die* cur_;
+        AnyDie* any_;
+        std::shared_ptr<AnyDie> owner_;
+        bool siblings_;
+        bool descend_;
+        bool skip_;
+    };
+
+    class DieRange {
+    public:
+        DieRange(Die* start, AnyDie* start_any, bool siblings, bool descend,
+                 std::shared_ptr<AnyDie> owner = nullptr)
+            : start_(start)
+            , start_any_(start_any)
+            , siblings_(siblings)
+            , descend_(descend)
+            , owner_(owner)
+        {}
+
+        DieIterator begin() const {
+            if (!start_)
+                return DieIterator();
+            return DieIterator(start_, start_any_, siblings_, descend_);
+        }
+
+        DieIterator end() const {
+            return DieIterator();
+        }
+
+    private:
+        Die* start_;
+        AnyDie* start_any_;
+        bool siblings_;
+        bool descend_;
+        std::shared_ptr<AnyDie> owner_;
+    };
+
     template <typename T>
     void Die::visit_die(T& visitor, AnyDie& die) {
         if (die.type() == typeid(EmptyDie))
             return;
 
         visitor_to_die vtd;
+        DieIterator end;
+        for (DieIterator it(&die.apply_visitor(vtd), &die, true, true); it != end; ++it) {
+            switch (it.any()->apply_visitor(visitor)) {
+                case Die::TraversalResult::SKIP:  it.skip_children(); break;
+                case Die::TraversalResult::BREAK: return;
 
-        Die& handle = die.apply_visitor(vtd);
-
-        switch (die.apply_visitor(visitor)) {
-            case Die::TraversalResult::SKIP:  break;
-            case Die::TraversalResult::BREAK: return;
-
-            default:
-            case Die::TraversalResult::TRAVERSE:
-                handle.init_child();
-                visit_die(visitor, *handle.data_->child);
+                default:
+                case Die::TraversalResult::TRAVERSE: break;
+            }
         }
-        handle.init_sibling();
-        visit_die(visitor, *handle.data_->sibling);
     }
 
     template <typename T>
@@ -230,6 +400,53 @@ namespace Dwarf {
         visit_die(visitor, *data_->child);
     }
 
+    namespace detail {
+
+        template <typename V>
+        struct DieThunk {
+            using R = typename V::result_type;
+            using Fn = R (*)(V&, Die&);
+
+            template <unsigned Tag>
+            struct Known {
+                static R call(V& visitor, Die& die) {
+                    // the table already picked the tag: a new handle of the
+                    // right type is cheaper than checking the dynamic type
+                    TaggedDie<Tag> tagged(die);
+                    return visitor(tagged);
+                }
+            };
+
+            struct Unknown {
+                static R call(V& visitor, Die& die) {
+                    return visitor(die);
+                }
+            };
+        };
+
+    }
+
+    template <typename T>
+    typename T::result_type Die::dispatch(T& visitor) {
+        return TagTable<detail::DieThunk<T>>::get(data_->tag)(visitor, *this);
+    }
+
+    template <typename T>
+    typename T::result_type Die::dispatch(T& visitor, std::weak_ptr<const Debug> dbg, dwarf::Dwarf_Die die) {
+        Die handle(dbg, die);
+        return handle.dispatch(visitor);
+    }
+
+    template <typename T>
+    void Die::dispatch_die(T& visitor, Die& die) {
+        if (!die.data_)
+            return;
+
+        walk(die, [](void* context, Die& cur) -> Die::TraversalResult {
+            return cur.dispatch(*static_cast<T*>(context));
+        }, &visitor);
+    }
+
     template <unsigned int Tag>
     std::shared_ptr<AnyDie> Die::make_die(std::weak_ptr<const Debug>& dbg, dwarf::Dwarf_Die die) {
         return std::make_shared<AnyDie>(TaggedDie<Tag>(dbg, die));
@@ -0,0 +1,124 @@
+/*
+ *  This file is part of libdwarf++.
+ *
+ *  Copyright © 2015 Frankin "Snaipe" Mathieu <http://snaipe.me>
+ *
+ *  libdwarf++ is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libdwarf++ is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libdwarf++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LIBDWARFPP_DIEREF_HH
+# define LIBDWARFPP_DIEREF_HH
+
+# include <cstdint>
+# include <type_traits>
+# include "dwarf.hh"
+# include "attributes.hh"
+# include "dietable.hh"
+
+namespace Dwarf {
+
+    /*
+     * Plain reference to a DIE: its unit and its row in the unit's
+     * DieTable. It holds no reference count; every operation goes through
+     * a DieContext.
+     */
+    struct DieRef {
+        uint32_t cu;                // index in Debug::cu()
+        DieTable::Index row;
+
+        bool valid() const {
+            return row != DieTable::npos;
+        }
+
+        bool operator==(const DieRef& other) const {
+            return cu == other.cu && row == other.row;
+        }
+
+        bool operator!=(const DieRef& other) const {
+            return !(*this == other);
+        }
+    };
+
+    static_assert(std::is_trivially_copyable<DieRef>::value,
+                  "DieRef must stay trivially copyable");
+
+    /*
+     * Borrowed cursor that DieRefs are resolved against. The Debug must
+     * outlive it, and like the Debug it belongs to a single thread.
+     *
+     * The table of the last unit used is kept, so navigation within a
+     * unit is array lookups only: no reference counting and no
+     * allocation. The attributes of the last DIE read are kept as well:
+     * reading several attributes of one DIE goes through libdwarf once.
+     */
+    class DieContext final {
+    public:
+        explicit DieContext(const Debug& dbg);
+
+        const Debug& debug() const {
+            return dbg_;
+        }
+
+        /* Root DIE of the unit. */
+        DieRef unit(size_t cu);
+
+        /* DIE at the given .debug_info offset of the Debug, or an invalid
+         * reference. The skeleton DIE of a split unit is its root. */
+        DieRef at(Dwarf::Off offset);
+
+        Dwarf::Off offset(DieRef r)     { return table(r.cu).offset(r.row); }
+        Dwarf::Half tag(DieRef r)       { return table(r.cu).tag(r.row); }
+        uint32_t depth(DieRef r)        { return table(r.cu).depth(r.row); }
+
+        DieRef parent(DieRef r)         { return { r.cu, table(r.cu).parent(r.row) }; }
+        DieRef first_child(DieRef r)    { return { r.cu, table(r.cu).first_child(r.row) }; }
+        DieRef next_sibling(DieRef r)   { return { r.cu, table(r.cu).next_sibling(r.row) }; }
+
+        /* Attributes of r, decoded in one call. Valid until the
+         * attributes of another DIE are read. */
+        const AttributeList& attributes(DieRef r);
+
+        /* Decoded value of attr, or an empty value if r lacks it. */
+        AttributeValue value(DieRef r, Dwarf::Half attr);
+
+        /* Target of a reference attribute, or an invalid reference. */
+        DieRef reference(DieRef r, Dwarf::Half attr);
+
+        /* Full Die for r, shared through the Debug's DIE cache. */
+        std::shared_ptr<AnyDie> materialize(DieRef r);
+
+        /* DieTable of the unit; switching units is the only slow path. */
+        const DieTable& table(uint32_t cu) {
+            if (cu != cu_)
+                load(cu);
+            return *table_;
+        }
+
+    private:
+        void load(uint32_t cu);
+        DieRef split_at(Dwarf::Off offset);
+
+        const Debug& dbg_;
+        const Debug* unit_dbg_;     // differs from dbg_ for split units
+        const CompilationUnit* unit_;
+        const DieTable* table_;
+        uint32_t cu_;
+
+        DieRef attrs_ref_;
+        AttributeList attrs_;
+    };
+
+}
+
+#endif /* !LIBDWARFPP_DIEREF_HH */
@@ -0,0 +1,86 @@
+/*
+ *  This file is part of libdwarf++.
+ *
+ *  Copyright © 2015 Frankin "Snaipe" Mathieu <http://snaipe.me>
+ *
+ *  libdwarf++ is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libdwarf++ is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libdwarf++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LIBDWARFPP_DIETABLE_HH
+# define LIBDWARFPP_DIETABLE_HH
+
+# include <cstdint>
+# include <vector>
+# include <memory>
+# include "dwarf.hh"
+
+namespace Dwarf {
+
+    /*
+     * Flat, preorder table of every DIE of a compilation unit, stored as
+     * parallel arrays. The unit is decoded once; scans and lookups then run
+     * against the arrays without allocating, and a Die can be materialized
+     * from any row on demand.
+     */
+    class DieTable final {
+    public:
+        using Index = uint32_t;
+        static constexpr Index npos = static_cast<Index>(-1);
+
+        DieTable(std::shared_ptr<const Debug> dbg, Dwarf::Off cu_die_offset);
+
+        Index size() const {
+            return static_cast<Index>(offsets_.size());
+        }
+
+        Dwarf::Off offset(Index i) const        { return offsets_[i]; }
+        Dwarf::Half tag(Index i) const          { return tags_[i]; }
+        uint32_t depth(Index i) const           { return depths_[i]; }
+        Index parent(Index i) const             { return parents_[i]; }
+        Index next_sibling(Index i) const       { return siblings_[i]; }
+        uint32_t abbrev_code(Index i) const     { return abbrevs_[i]; }
+
+        Index first_child(Index i) const {
+            return i + 1 < size() && parents_[i + 1] == i ? i + 1 : npos;
+        }
+
+        /* Row following the whole subtree of i, in preorder. */
+        Index subtree_end(Index i) const;
+
+        /* Row of the DIE at offset, or npos if it is not part of the unit. */
+        Index find(Dwarf::Off offset) const;
+
+        std::shared_ptr<AnyDie> materialize(Index i) const;
+
+        const std::vector<Dwarf::Off>& offsets() const    { return offsets_; }
+        const std::vector<Dwarf::Half>& tags() const      { return tags_; }
+        const std::vector<uint32_t>& depths() const       { return depths_; }
+        const std::vector<Index>& parents() const         { return parents_; }
+        const std::vector<Index>& siblings() const        { return siblings_; }
+        const std::vector<uint32_t>& abbrev_codes() const { return abbrevs_; }
+
+    private:
+        std::weak_ptr<const Debug> dbg_;
+
+        std::vector<Dwarf::Off> offsets_;
+        std::vector<Dwarf::Half> tags_;
+        std::vector<uint32_t> depths_;
+        std::vector<Index> parents_;
+        std::vector<Index> siblings_;
+        std::vector<uint32_t> abbrevs_;
+    };
+
+}
+
+#endif /* !LIBDWARFPP_DIETABLE_HH */
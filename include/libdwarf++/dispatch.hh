@@ -0,0 +1,216 @@
+/*
+ *  This file is part of libdwarf++.
+ *
+ *  Copyright © 2015 Frankin "Snaipe" Mathieu <http://snaipe.me>
+ *
+ *  libdwarf++ is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libdwarf++ is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libdwarf++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LIBDWARFPP_DISPATCH_HH
+# define LIBDWARFPP_DISPATCH_HH
+
+# include <array>
+# include <cstddef>
+# include <type_traits>
+# include <utility>
+# include "cdwarf"
+
+namespace Dwarf {
+
+    namespace detail {
+
+        constexpr bool tag_in(unsigned) {
+            return false;
+        }
+
+        template <typename... T>
+        constexpr bool tag_in(unsigned tag, unsigned first, T... rest) {
+            return tag == first || tag_in(tag, rest...);
+        }
+
+        constexpr unsigned tag_max() {
+            return 0;
+        }
+
+        constexpr unsigned tag_larger(unsigned a, unsigned b) {
+            return a > b ? a : b;
+        }
+
+        template <typename... T>
+        constexpr unsigned tag_max(unsigned first, T... rest) {
+            return tag_larger(first, tag_max(rest...));
+        }
+
+    }
+
+    template <unsigned... Tags>
+    struct TagList {
+        static constexpr size_t count = sizeof...(Tags);
+
+        static constexpr unsigned max() {
+            return detail::tag_max(Tags...);
+        }
+
+        static constexpr bool contains(unsigned tag) {
+            return detail::tag_in(tag, Tags...);
+        }
+    };
+
+    /* Tags with a TaggedDie alternative in AnyDie. */
+    using KnownTags = TagList<
+            DW_TAG_array_type,
+            DW_TAG_class_type,
+            DW_TAG_entry_point,
+            DW_TAG_enumeration_type,
+            DW_TAG_formal_parameter,
+            DW_TAG_imported_declaration,
+            DW_TAG_label,
+            DW_TAG_lexical_block,
+            DW_TAG_member,
+            DW_TAG_pointer_type,
+            DW_TAG_reference_type,
+            DW_TAG_compile_unit,
+            DW_TAG_string_type,
+            DW_TAG_structure_type,
+            DW_TAG_subroutine_type,
+            DW_TAG_typedef,
+            DW_TAG_union_type,
+            DW_TAG_unspecified_parameters,
+            DW_TAG_variant,
+            DW_TAG_common_block,
+            DW_TAG_common_inclusion,
+            DW_TAG_inheritance,
+            DW_TAG_inlined_subroutine,
+            DW_TAG_module,
+            DW_TAG_ptr_to_member_type,
+            DW_TAG_set_type,
+            DW_TAG_subrange_type,
+            DW_TAG_with_stmt,
+            DW_TAG_access_declaration,
+            DW_TAG_base_type,
+            DW_TAG_catch_block,
+            DW_TAG_const_type,
+            DW_TAG_constant,
+            DW_TAG_enumerator,
+            DW_TAG_file_type,
+            DW_TAG_friend,
+            DW_TAG_namelist,
+            DW_TAG_namelist_item,
+            DW_TAG_packed_type,
+            DW_TAG_subprogram,
+            DW_TAG_template_type_parameter,
+            DW_TAG_template_value_parameter,
+            DW_TAG_thrown_type,
+            DW_TAG_try_block,
+            DW_TAG_variant_part,
+            DW_TAG_variable,
+            DW_TAG_volatile_type,
+            DW_TAG_dwarf_procedure,
+            DW_TAG_restrict_type,
+            DW_TAG_interface_type,
+            DW_TAG_namespace,
+            DW_TAG_imported_module,
+            DW_TAG_unspecified_type,
+            DW_TAG_partial_unit,
+            DW_TAG_imported_unit,
+            DW_TAG_mutable_type,
+            DW_TAG_condition,
+            DW_TAG_shared_type,
+            DW_TAG_type_unit,
+            DW_TAG_rvalue_reference_type,
+            DW_TAG_template_alias,
+            DW_TAG_coarray_type,
+            DW_TAG_generic_subrange,
+            DW_TAG_dynamic_type,
+            DW_TAG_atomic_type,
+            DW_TAG_call_site,
+            DW_TAG_call_site_parameter
+        >;
+
+    /*
+     * Dense table indexed by tag, built at compile time. Known tags map to
+     * Thunk::Known<Tag>::call, every other tag, such as vendor extensions
+     * past the end of the table, to Thunk::Unknown::call.
+     */
+    template <typename Thunk, typename List = KnownTags>
+    struct TagTable;
+
+    template <typename Thunk, unsigned... Tags>
+    struct TagTable<Thunk, TagList<Tags...>> {
+        using Fn = typename Thunk::Fn;
+        using List = TagList<Tags...>;
+
+        static constexpr size_t size = List::max() + 1;
+
+        static Fn get(unsigned tag) {
+            return tag < size ? table[tag] : &Thunk::Unknown::call;
+        }
+
+    private:
+        template <size_t I>
+        static constexpr Fn entry() {
+            return &std::conditional_t<List::contains(I),
+                    typename Thunk::template Known<I>,
+                    typename Thunk::Unknown>::call;
+        }
+
+        template <size_t... I>
+        static constexpr std::array<Fn, size> build(std::index_sequence<I...>) {
+            return {{ entry<I>()... }};
+        }
+
+    public:
+        static constexpr std::array<Fn, size> table = build(std::make_index_sequence<size>());
+    };
+
+    template <typename Thunk, unsigned... Tags>
+    constexpr std::array<typename TagTable<Thunk, TagList<Tags...>>::Fn, TagTable<Thunk, TagList<Tags...>>::size>
+        TagTable<Thunk, TagList<Tags...>>::table;
+
+    namespace detail {
+
+        template <typename V>
+        struct TagThunk {
+            using R = typename V::result_type;
+            using Fn = R (*)(V&, unsigned);
+
+            template <unsigned Tag>
+            struct Known {
+                static R call(V& visitor, unsigned) {
+                    return visitor(std::integral_constant<unsigned, Tag>());
+                }
+            };
+
+            struct Unknown {
+                static R call(V& visitor, unsigned tag) {
+                    return visitor(tag);
+                }
+            };
+        };
+
+    }
+
+    /*
+     * Calls visitor(std::integral_constant<unsigned, Tag>()) for a known
+     * tag and visitor(tag) otherwise, with a single table jump. Suited to
+     * tag-only data such as DieTable rows, where there is no Die to visit.
+     */
+    template <typename V>
+    typename V::result_type dispatch_tag(unsigned tag, V& visitor) {
+        return TagTable<detail::TagThunk<V>>::get(tag)(visitor, tag);
+    }
+
+}
+
+#endif /* !LIBDWARFPP_DISPATCH_HH */
@@ -20,11 +20,15 @@
 #ifndef LIBDWARFPP_DWARF_HH
 # define LIBDWARFPP_DWARF_HH
 
+# include <functional>
+# include <string>
 # include <vector>
 # include <memory>
+# include <unordered_map>
 # include "cdwarf"
 # include "exception.hh"
 # include "anydie.hh"
+# include "span.hh"
 
 namespace Dwarf {
 
@@ -45,14 +49,29 @@ namespace Dwarf {
     template <> struct TypeKind<dwarf::Dwarf_Error>     { enum {Kind = DW_DLA_ERROR}; };
     template <> struct TypeKind<dwarf::Dwarf_Die >      { enum {Kind = DW_DLA_DIE}; };
     template <> struct TypeKind<dwarf::Dwarf_Attribute> { enum {Kind = DW_DLA_ATTR}; };
-    template <> struct TypeKind<dwarf::Dwarf_Locdesc**> { enum {Kind = DW_DLA_LOCDESC}; };
-    template <> struct TypeKind<dwarf::Dwarf_Loc*>      { enum {Kind = DW_DLA_LOC}; };
+    template <> struct TypeKind<dwarf::Dwarf_Attribute*>{ enum {Kind = DW_DLA_LIST}; };
+    template <> struct TypeKind<dwarf::Dwarf_Locdesc**> { enum {Kind = DW_DLA_LIST}; };
+    template <> struct TypeKind<dwarf::Dwarf_Locdesc*>  { enum {Kind = DW_DLA_LOCDESC}; };
+    template <> struct TypeKind<dwarf::Dwarf_Loc*>      { enum {Kind = DW_DLA_LOC_BLOCK}; };
     template <> struct TypeKind<dwarf::Dwarf_Block*>    { enum {Kind = DW_DLA_BLOCK}; };
     template <> struct TypeKind<char *>                 { enum {Kind = DW_DLA_STRING}; };
+    template <> struct TypeKind<char **>                { enum {Kind = DW_DLA_LIST}; };
 
     class CUIterator;
     class CompilationUnit;
+    struct CUHeader;
     class Die;
+    class AddressIndex;
+    struct LineInfo;
+    class NameIndex;
+    class DieCache;
+    class Expression;
+    class CallFrameInfo;
+    class ObjectImage;
+    class IndexFile;
+    class TypeResolver;
+    class TypeIndex;
+    class SubtreeSkipper;
 
     class Debug final : public std::enable_shared_from_this<Debug> {
     public:
@@ -62,15 +81,24 @@ namespace Dwarf {
         template <typename T>
         void dealloc(T& val) const;
 
-        CUIterator& begin() const;
-        CUIterator& end() const;
-        CUIterator& cbegin() const;
-        CUIterator& cend() const;
+        /*
+         * Range over the compilation units. Opening a Debug reads no unit;
+         * the unit table is scanned by the first begin(). Iterators are
+         * independent and can be restarted at will.
+         */
+        CUIterator begin() const;
+        CUIterator end() const;
+        CUIterator cbegin() const;
+        CUIterator cend() const;
 
         operator std::shared_ptr<const Debug>() const;
 
+        /* Handles are equal if they were opened from the same file, or
+         * share the image they were opened from memory with. */
         bool operator==(const Debug &other) const {
-            return fd_ == other.fd_;
+            if (ino_ || other.ino_)
+                return dev_ == other.dev_ && ino_ == other.ino_;
+            return image_ == other.image_ && fd_ == other.fd_;
         }
 
         bool operator!=(const Debug &other) const {
@@ -83,21 +111,216 @@ namespace Dwarf {
             return handle_;
         }
 
+        /*
+         * Returns the DIE at offset. Materialized DIEs are kept in a bounded
+         * cache, so repeated lookups of one offset share a single instance
+         * and its lazily loaded state.
+         */
         std::shared_ptr<AnyDie> offdie(Dwarf::Off offset) const;
 
+        /*
+         * Type DIE of the type unit with the given DW_FORM_ref_sig8
+         * signature, or nullptr. Type units may live in .debug_types, whose
+         * offsets overlap .debug_info, so these DIEs are not cached.
+         */
+        std::shared_ptr<AnyDie> signature_die(uint64_t signature) const;
+
+        /*
+         * Resolves a batch of offsets like offdie(Dwarf::Off) each, in
+         * section order so that libdwarf moves through the units once;
+         * repeated offsets share one DIE.
+         */
+        std::vector<std::shared_ptr<AnyDie>> offdie(const std::vector<Dwarf::Off>& offsets) const;
+
+        /* Bounds the offdie cache; 0 disables it. */
+        void set_die_cache_size(size_t entries) const;
+
+        /*
+         * Random access to the compilation units. The header table is built
+         * on first use with a single scan; units are materialized on demand.
+         */
+        size_t cu_count() const;
+        const CUHeader& cu_header(size_t index) const;
+        const CompilationUnit& cu(size_t index) const;
+
+        /* Index of the unit containing the given .debug_info offset, or
+         * cu_count() if there is none. O(log n). */
+        size_t cu_index_for_offset(Dwarf::Off offset) const;
+        const CompilationUnit* cu_for_offset(Dwarf::Off offset) const;
+
+        /*
+         * Sets sibling to the offset of the DIE that follows the subtree of
+         * the DIE at offset, or to 0 if it is the last of its siblings,
+         * without decoding the subtree: DW_AT_sibling is followed when
+         * present, and DIEs are otherwise stepped over by abbreviation.
+         * Returns false when this cannot be done, e.g. when the sections
+         * cannot be read, in which case dwarf_siblingof has to be used.
+         */
+        bool next_sibling_offset(Dwarf::Off offset, Dwarf::Off& sibling) const;
+
+        /*
+         * Bytes of the named section, e.g. for sections libdwarf has no
+         * reader for. Sections compressed on disk are decompressed on
+         * first use. Empty if the section is missing or cannot be read.
+         */
+        Span<const Dwarf::Small> raw_section(const char* name) const;
+
+        /* Address to unit/subprogram index, built on first use. */
+        const AddressIndex& address_index() const;
+
+        /*
+         * Resolves file:line for a batch of addresses sorted in ascending
+         * order, in a single merge pass over the unit ranges and line
+         * tables. Unresolved addresses get a null file.
+         */
+        std::vector<LineInfo> lookup_lines(const std::vector<Dwarf::Addr>& addrs) const;
+
+        /* By-name DIE index, built in parallel on first use. */
+        const NameIndex& name_index() const;
+
+        /* Structurally deduplicated types of all units, built in parallel
+         * on first use. */
+        const TypeIndex& type_index() const;
+
+        /* Memoized type resolution and layouts; see TypeResolver. */
+        const TypeResolver& types() const;
+
+        /* .debug_frame and .eh_frame unwind information, indexed on first use. */
+        const CallFrameInfo& call_frame_info() const;
+
+        /*
+         * Split unit of a skeleton unit, looked up by dwo_id in the .dwp
+         * package next to this object, then in the unit's .dwo file. Files
+         * are opened on first use and stay open with this Debug. nullptr if
+         * the unit cannot be found.
+         */
+        const CompilationUnit* split_unit(const char* dwo_name, const char* comp_dir, uint64_t dwo_id) const;
+
+        /*
+         * Persists the unit table and the name, address and type indexes
+         * in dir, keyed by the build-id of the object. A valid index file found
+         * there is mapped read-only, and the indexes it holds are used in
+         * place of building them. Each time an index is built, the file is
+         * rewritten with the indexes built or loaded so far. Objects without
+         * a build-id are not cached.
+         */
+        void set_index_cache(const std::string& dir) const;
+
+        /* Hex GNU build-id of the object, empty if it has none. */
+        const std::string& build_id() const;
+
+        /* Size in bytes of a target address. */
+        Dwarf::Half address_size() const;
+
+        /*
+         * Compiles the expression stored in bytes, which must point into the
+         * sections of this object, e.g. a DW_FORM_exprloc value. Compiled
+         * expressions are cached by their position, so each one is only
+         * decoded once.
+         */
+        std::shared_ptr<const Expression> expression(Span<const Dwarf::Small> bytes) const;
+
+        /*
+         * Opens an independent handle over the same object. libdwarf handles
+         * are not thread-safe, so this is what other threads should use.
+         * Reopened handles share one read-only mapping of the object, made
+         * by the first call for handles that were not opened mapped.
+         */
+        std::shared_ptr<const Debug> reopen() const;
+
+        using CUCallback = std::function<void(const CompilationUnit&)>;
+
+        /*
+         * Calls func on every compilation unit, spread over threads workers
+         * (0 means one per hardware thread). Each worker has its own
+         * libdwarf handle; the unit passed to func is only valid for the
+         * duration of the call. Calls may happen concurrently.
+         */
+        void parallel_for_each_cu(const CUCallback& func, unsigned threads = 0) const;
+
         static std::shared_ptr<const Debug> open(const char *path);
         static std::shared_ptr<const Debug> self();
 
+        enum class Preload {
+            NONE,           // pages are faulted in on first access
+            READAHEAD,      // start asynchronous readahead of the debug sections
+            POPULATE,       // fault the whole mapping in before returning
+        };
+
+        struct MapOptions {
+            Preload preload = Preload::NONE;
+
+            /* Workers decompressing compressed sections, 0 means one per
+             * hardware thread. */
+            unsigned threads = 0;
+
+            /* If set, decompressed sections are cached in this directory,
+             * keyed by build-id, and mapped from there on later opens. */
+            std::string cache_dir;
+
+            /* Checks the crc32 of cached sections on every open, which
+             * reads them whole; otherwise only their size and trailer. */
+            bool verify_cache = false;
+        };
+
+        /*
+         * Opens path through a read-only mapping that libdwarf reads
+         * sections from directly. Handles returned by reopen() share the
+         * mapping. zlib compressed sections (SHF_COMPRESSED or .zdebug_*)
+         * are decompressed up front. Returns nullptr if the file cannot be
+         * mapped.
+         */
+        static std::shared_ptr<const Debug> open_mapped(const char *path, const MapOptions& options);
+        static std::shared_ptr<const Debug> open_mapped(const char *path, Preload preload = Preload::NONE);
+
+        /*
+         * Opens an ELF image that is already in memory, without copying it.
+         * bytes must outlive the returned Debug and its reopened handles.
+         */
+        static std::shared_ptr<const Debug> from_memory(Span<const Dwarf::Small> bytes);
+
     private:
         Debug(int fd, Unsigned access = DW_DLC_READ, Handler = nullptr, Ptr errarg = nullptr)
             throw(InitException, NoDebugInformationException);
+        Debug(std::shared_ptr<ObjectImage> image)
+            throw(InitException, NoDebugInformationException);
+
+        static std::shared_ptr<const Debug> make(Debug* dbg, const std::string& path);
+        std::shared_ptr<const Debug> open_split(const std::string& path) const;
 
         int fd_;
+        std::shared_ptr<ObjectImage> image_;
+        mutable std::shared_ptr<ObjectImage> reopen_image_;
+        std::string path_;
+        uint64_t dev_ = 0;
+        uint64_t ino_ = 0;
         dwarf::Dwarf_Debug handle_;
-        std::vector<CompilationUnit> cus_;
+        void load_cu_headers() const;
+        void save_index() const;
 
-        std::unique_ptr<CUIterator> begin_;
-        std::unique_ptr<CUIterator> end_;
+        mutable bool cus_loaded_ = false;
+        mutable bool cu_cursor_dirty_ = false;
+        mutable std::vector<CUHeader> cu_headers_;
+        mutable std::vector<std::shared_ptr<CompilationUnit>> cus_;
+        mutable std::shared_ptr<const AddressIndex> address_index_;
+        mutable std::shared_ptr<const NameIndex> name_index_;
+        mutable std::shared_ptr<const TypeIndex> type_index_;
+        std::unique_ptr<DieCache> die_cache_;
+        mutable std::shared_ptr<const CallFrameInfo> cfi_;
+        mutable std::shared_ptr<const TypeResolver> types_;
+        mutable bool raw_loaded_ = false;
+        mutable std::shared_ptr<const void> raw_map_;
+        mutable bool skipper_loaded_ = false;
+        mutable std::shared_ptr<const SubtreeSkipper> skipper_;
+        mutable std::string index_dir_;
+        mutable std::shared_ptr<const IndexFile> index_file_;
+        mutable bool build_id_loaded_ = false;
+        mutable std::string build_id_;
+        mutable bool dwp_loaded_ = false;
+        mutable std::shared_ptr<const Debug> dwp_;
+        mutable std::unordered_map<std::string, std::shared_ptr<const Debug>> dwos_;
+        mutable Dwarf::Half address_size_ = 0;
+        mutable std::unordered_map<const Dwarf::Small*, std::shared_ptr<const Expression>> expressions_;
     };
 };
 
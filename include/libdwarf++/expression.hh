@@ -0,0 +1,141 @@
+/*
+ *  This file is part of libdwarf++.
+ *
+ *  Copyright © 2015 Frankin "Snaipe" Mathieu <http://snaipe.me>
+ *
+ *  libdwarf++ is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libdwarf++ is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libdwarf++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LIBDWARFPP_EXPRESSION_HH
+# define LIBDWARFPP_EXPRESSION_HH
+
+# include <cstdint>
+# include <functional>
+# include <vector>
+# include "cdwarf"
+# include "span.hh"
+
+namespace Dwarf {
+
+    /*
+     * One piece of an object's location. Unless the location was split with
+     * DW_OP_piece, there is a single piece with a size of 0 covering the
+     * whole object.
+     */
+    struct Piece {
+        enum Kind : uint8_t {
+            MEMORY,             // value is an address
+            REGISTER,           // value is a DWARF register number
+            VALUE,              // value is the object's value (DW_OP_stack_value)
+            IMPLICIT,           // value points to size / 8 bytes of data
+            UNDEFINED,          // optimized out
+        };
+
+        Kind kind;
+        uint64_t value;
+        uint64_t size;          // in bits
+        uint64_t offset;        // in bits, from DW_OP_bit_piece
+    };
+
+    struct Location {
+        std::vector<Piece> pieces;
+
+        /* True for locations that are a single, computed value. */
+        bool is_value() const {
+            return pieces.size() == 1 && pieces[0].kind == Piece::VALUE;
+        }
+    };
+
+    /*
+     * A DWARF expression decoded once into a flat list of operations, with
+     * branch targets resolved to operation indices. Expressions that do not
+     * depend on memory or registers are folded into a constant when they
+     * are compiled.
+     */
+    class Expression final {
+    public:
+        struct Op {
+            Dwarf::Small code;
+            uint64_t a;             // first operand
+            uint64_t b;             // second operand, or branch target index
+        };
+
+        /* Evaluation stack bound; deeper expressions fail to evaluate. */
+        static constexpr size_t max_stack = 64;
+
+        /*
+         * State of the frame an expression is evaluated in. Registers are
+         * indexed by DWARF register number. frame_base and cfa back
+         * DW_OP_fbreg and DW_OP_call_frame_cfa; read_memory defaults to
+         * reading the current process.
+         */
+        struct Context {
+            Span<const uint64_t> registers;
+            std::function<uint64_t()> frame_base;
+            std::function<uint64_t()> cfa;
+            std::function<uint64_t(uint64_t addr, size_t size)> read_memory;
+        };
+
+        /*
+         * Compiles raw expression bytes, e.g. a DW_FORM_exprloc value.
+         * offset_size is that of the unit, 8 in 64-bit DWARF. Throws for
+         * opcodes it does not know the operands of.
+         */
+        Expression(Span<const Dwarf::Small> bytes, Dwarf::Half address_size, Dwarf::Half offset_size = 4);
+
+        /* Compiles operations already decoded by libdwarf. */
+        Expression(const Dwarf::Loc* ops, size_t count, Dwarf::Half address_size);
+
+        bool is_constant() const {
+            return constant_;
+        }
+
+        uint64_t constant() const {
+            return value_;
+        }
+
+        /*
+         * Evaluates the expression without a register context; memory is
+         * read from the current process. Throws for operations that need
+         * registers or a frame.
+         */
+        uint64_t evaluate() const;
+
+        /* Evaluates the expression in the given frame. */
+        Location evaluate(const Context& ctx) const;
+
+        /*
+         * Evaluates the expression once per register snapshot, e.g. for
+         * every sample of a profile that hit the same frame.
+         */
+        std::vector<Location> evaluate(Span<const Context> frames) const;
+
+        const std::vector<Op>& ops() const {
+            return ops_;
+        }
+
+    private:
+        void link(const std::vector<uint64_t>& offsets);
+        void fold();
+
+        std::vector<Op> ops_;
+        bool constant_;
+        Piece::Kind constant_kind_;
+        uint64_t value_;
+        Dwarf::Half address_size_;
+    };
+
+}
+
+#endif /* !LIBDWARFPP_EXPRESSION_HH */
@@ -0,0 +1,79 @@
+/*
+ *  This file is part of libdwarf++.
+ *
+ *  Copyright © 2015 Frankin "Snaipe" Mathieu <http://snaipe.me>
+ *
+ *  libdwarf++ is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libdwarf++ is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libdwarf++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LIBDWARFPP_LINETABLE_HH
+# define LIBDWARFPP_LINETABLE_HH
+
+# include <cstdint>
+# include <string>
+# include <vector>
+# include "dwarf.hh"
+
+namespace Dwarf {
+
+    struct LineInfo {
+        const char* file;           // nullptr if the address was not found
+        uint32_t line;
+        uint32_t column;
+    };
+
+    /*
+     * Decoded line program of a compilation unit: packed rows sorted by
+     * address, with file names interned once per unit.
+     */
+    class LineTable final {
+    public:
+        struct Row {
+            Dwarf::Addr addr;
+            uint32_t line;
+            uint32_t file;
+            uint32_t column : 30;
+            uint32_t is_stmt : 1;
+            uint32_t end_sequence : 1;
+        };
+
+        /* Files are numbered after the version of the line program header;
+         * unit_version is only used if that header cannot be read. */
+        LineTable(const Debug& dbg, dwarf::Dwarf_Die cu_die, Dwarf::Half unit_version);
+
+        /* Row covering pc, or nullptr if pc falls outside every sequence. */
+        const Row* find(Dwarf::Addr pc) const;
+
+        /* Index of the row covering pc, or rows().size(). */
+        size_t find_index(Dwarf::Addr pc) const;
+
+        LineInfo info(const Row& row) const {
+            return { files_[row.file].c_str(), row.line, row.column };
+        }
+
+        const char* file_name(unsigned index) const {
+            return files_[index].c_str();
+        }
+
+        const std::vector<Row>& rows() const             { return rows_; }
+        const std::vector<std::string>& files() const    { return files_; }
+
+    private:
+        std::vector<Row> rows_;
+        std::vector<std::string> files_;
+    };
+
+}
+
+#endif /* !LIBDWARFPP_LINETABLE_HH */
@@ -0,0 +1,84 @@
+/*
+ *  This file is part of libdwarf++.
+ *
+ *  Copyright © 2015 Frankin "Snaipe" Mathieu <http://snaipe.me>
+ *
+ *  libdwarf++ is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libdwarf++ is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libdwarf++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LIBDWARFPP_LOCLIST_HH
+# define LIBDWARFPP_LOCLIST_HH
+
+# include <memory>
+# include <vector>
+# include "cdwarf"
+# include "expression.hh"
+
+namespace Dwarf {
+
+    class Debug;
+
+    /*
+     * Location of a variable as a table of pc ranges, sorted by start
+     * address, each with its compiled expression. A single location
+     * expression becomes one entry covering every address.
+     */
+    class LocationList final {
+    public:
+        struct Entry {
+            Dwarf::Addr lo;
+            Dwarf::Addr hi;         // exclusive
+            Expression expr;
+        };
+
+        /* What decoding needs to know about the enclosing unit. */
+        struct Unit {
+            Dwarf::Addr base = 0;           // base address for list entries
+            Dwarf::Half version = 0;
+            Dwarf::Half address_size = 0;
+            Dwarf::Half offset_size = 4;    // 8 in 64-bit DWARF
+            Dwarf::Off addr_base = 0;       // DW_AT_addr_base, into .debug_addr
+            Dwarf::Off loclists_base = 0;   // DW_AT_loclists_base, into .debug_loclists
+        };
+
+        /*
+         * Decodes attr: DWARF 5 lists in .debug_loclists are read from the
+         * section, since dwarf_loclist_n only knows .debug_loc; the rest
+         * goes through dwarf_loclist_n.
+         */
+        LocationList(const Debug& dbg, dwarf::Dwarf_Attribute attr, const Unit& unit);
+
+        /* Expression in effect at pc, or nullptr if the object has no
+         * location there. O(log n), plus the entries overlapping pc. */
+        const Expression* find(Dwarf::Addr pc) const;
+
+        /* Location at pc; a single undefined piece if there is none. */
+        Location evaluate(Dwarf::Addr pc, const Expression::Context& ctx) const;
+
+        const std::vector<Entry>& entries() const {
+            return entries_;
+        }
+
+    private:
+        void load_v4(const Debug& dbg, dwarf::Dwarf_Attribute attr, Dwarf::Addr base);
+        void load_v5(const Debug& dbg, Dwarf::Off offset, bool indexed, const Unit& unit);
+
+        std::vector<Entry> entries_;
+        std::vector<Dwarf::Addr> reach_;            // highest hi of entries_[0..i]
+        std::shared_ptr<const Expression> default_; // DW_LLE_default_location
+    };
+
+}
+
+#endif /* !LIBDWARFPP_LOCLIST_HH */
@@ -0,0 +1,107 @@
+/*
+ *  This file is part of libdwarf++.
+ *
+ *  Copyright © 2015 Frankin "Snaipe" Mathieu <http://snaipe.me>
+ *
+ *  libdwarf++ is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libdwarf++ is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libdwarf++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LIBDWARFPP_NAMEINDEX_HH
+# define LIBDWARFPP_NAMEINDEX_HH
+
+# include <cstdint>
+# include <cstring>
+# include <memory>
+# include <vector>
+# include "dwarf.hh"
+# include "span.hh"
+
+namespace Dwarf {
+
+    inline uint64_t hash_name(const char* name, size_t len) {
+        uint64_t h = 0xcbf29ce484222325ull;
+        for (size_t i = 0; i < len; ++i) {
+            h ^= static_cast<unsigned char>(name[i]);
+            h *= 0x100000001b3ull;
+        }
+        return h;
+    }
+
+    /*
+     * Hash table from DIE names (and linkage names, when present) to DIE
+     * offsets and tags, built in one parallel pass over all units. Only
+     * the names are kept: the table is a flat array of entries grouped by
+     * bucket, plus a pool of NUL-terminated names.
+     */
+    class NameIndex final {
+    public:
+        enum Flags : uint16_t {
+            LINKAGE_NAME = 1 << 0,  // the key is the linkage name of the DIE
+            DECLARATION  = 1 << 1,  // the DIE has DW_AT_declaration
+        };
+
+        struct Entry {
+            uint64_t hash;
+            uint32_t name;          // offset in the name pool
+            uint32_t cu;            // index in Debug::cu()
+            Dwarf::Off die;
+            Dwarf::Half tag;
+            uint16_t flags;
+        };
+
+        explicit NameIndex(const Debug& dbg, unsigned threads = 0);
+
+        /* Index over tables stored elsewhere, e.g. in an index file, which
+         * owner keeps alive. */
+        NameIndex(Span<const Entry> entries, Span<const uint32_t> buckets,
+                  Span<const char> pool, std::shared_ptr<const void> owner);
+
+        /* First entry named name with the given tag (any tag if 0). */
+        const Entry* find_by_name(const char* name, Dwarf::Half tag = 0) const;
+
+        /* Every entry named name with the given tag (any tag if 0). */
+        std::vector<const Entry*> find_all(const char* name, Dwarf::Half tag = 0) const;
+
+        /* Whether the tables are consistent with each other and with a
+         * Debug of cu_count units; tables read from a file are checked
+         * before use. */
+        bool valid(size_t cu_count) const;
+
+        const char* name(const Entry& e) const {
+            return &pool_[e.name];
+        }
+
+        size_t size() const {
+            return entries_.size();
+        }
+
+        Span<const Entry> entries() const       { return entries_; }
+        Span<const uint32_t> buckets() const    { return buckets_; }
+        Span<const char> pool() const           { return pool_; }
+
+    private:
+        struct Tables;
+
+        template <typename F>
+        void probe(const char* name, Dwarf::Half tag, F&& func) const;
+
+        Span<const Entry> entries_;
+        Span<const uint32_t> buckets_;      // bucket b spans [buckets_[b], buckets_[b + 1])
+        Span<const char> pool_;
+        std::shared_ptr<const void> owner_;
+    };
+
+}
+
+#endif /* !LIBDWARFPP_NAMEINDEX_HH */
@@ -0,0 +1,116 @@
+/*
+ *  This file is part of libdwarf++.
+ *
+ *  Copyright © 2015 Frankin "Snaipe" Mathieu <http://snaipe.me>
+ *
+ *  libdwarf++ is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libdwarf++ is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libdwarf++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LIBDWARFPP_REGISTRY_HH
+# define LIBDWARFPP_REGISTRY_HH
+
+# include <cstdint>
+# include <list>
+# include <memory>
+# include <mutex>
+# include <unordered_map>
+# include "dwarf.hh"
+
+namespace Dwarf {
+
+    /*
+     * Shared Debug handles, keyed by the identity of the file they were
+     * opened from (device, inode and modification time), so that opening
+     * an object that is already open is a stat and a hash lookup. Files
+     * are never shared by build-id: a stripped binary and its separate
+     * debug file carry the same one. Handles no longer referenced outside
+     * the registry are idle: they are kept around for reuse, and closed
+     * least recently used first past the idle limits.
+     *
+     * Returned handles are shared, and libdwarf handles are not
+     * thread-safe: threads that need their own should reopen() them.
+     */
+    class Registry final {
+    public:
+        struct Options {
+            /* Idle handles kept open. */
+            size_t max_idle = 64;
+
+            /* Total size in bytes of the files behind idle handles, 0 for
+             * no limit. */
+            size_t memory_budget = 0;
+
+            /* Open through Debug::open_mapped rather than Debug::open. */
+            bool mapped = false;
+            Debug::MapOptions map;
+        };
+
+        Registry();
+        explicit Registry(const Options& options);
+
+        Registry(const Registry&) = delete;
+        Registry& operator=(const Registry&) = delete;
+
+        /* Registry used by default, with default options. */
+        static Registry& global();
+
+        /* Shared handle for path, opened if needed; nullptr if the file
+         * cannot be opened. */
+        std::shared_ptr<const Debug> open(const char* path);
+
+        /* Closes idle handles past the limits. */
+        void trim();
+
+        /* Drops all handles; the ones still referenced stay valid. */
+        void clear();
+
+        size_t size() const;
+
+    private:
+        struct Key {
+            uint64_t dev;
+            uint64_t ino;
+            int64_t mtime_sec;
+            int64_t mtime_nsec;
+
+            bool operator==(const Key& other) const {
+                return dev == other.dev && ino == other.ino
+                    && mtime_sec == other.mtime_sec && mtime_nsec == other.mtime_nsec;
+            }
+        };
+
+        struct KeyHash {
+            size_t operator()(const Key& k) const;
+        };
+
+        struct Entry {
+            std::shared_ptr<const Debug> dbg;
+            size_t size;
+            Key key;
+        };
+
+        using Lru = std::list<Entry>;
+
+        void trim_locked();
+        Lru::iterator erase(Lru::iterator it);
+
+        Options options_;
+        mutable std::mutex mutex_;
+        Lru lru_;                                   // most recently used first
+        std::unordered_map<Key, Lru::iterator, KeyHash> by_file_;
+    };
+
+}
+
+#endif /* !LIBDWARFPP_REGISTRY_HH */
@@ -0,0 +1,65 @@
+/*
+ *  This file is part of libdwarf++.
+ *
+ *  Copyright © 2015 Frankin "Snaipe" Mathieu <http://snaipe.me>
+ *
+ *  libdwarf++ is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libdwarf++ is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libdwarf++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LIBDWARFPP_SPAN_HH
+# define LIBDWARFPP_SPAN_HH
+
+# include <cstddef>
+# include <utility>
+
+namespace Dwarf {
+
+    /*
+     * Non-owning view over a contiguous array, for data that lives in
+     * section bytes or in a mapping owned by someone else.
+     */
+    template <typename T>
+    class Span {
+    public:
+        using value_type = T;
+        using iterator = T*;
+
+        Span() = default;
+        Span(T* data, size_t size) : data_(data), size_(size) {}
+
+        template <typename Container,
+                  typename = decltype(std::declval<Container&>().data())>
+        Span(Container& c) : data_(c.data()), size_(c.size()) {}
+
+        T* data() const         { return data_; }
+        size_t size() const     { return size_; }
+        bool empty() const      { return size_ == 0; }
+
+        T* begin() const        { return data_; }
+        T* end() const          { return data_ + size_; }
+
+        T& operator[](size_t i) const { return data_[i]; }
+
+        Span subspan(size_t offset, size_t count) const {
+            return Span(data_ + offset, count);
+        }
+
+    private:
+        T* data_ = nullptr;
+        size_t size_ = 0;
+    };
+
+}
+
+#endif /* !LIBDWARFPP_SPAN_HH */
@@ -0,0 +1,93 @@
+/*
+ *  This file is part of libdwarf++.
+ *
+ *  Copyright © 2015 Frankin "Snaipe" Mathieu <http://snaipe.me>
+ *
+ *  libdwarf++ is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libdwarf++ is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libdwarf++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LIBDWARFPP_TYPEINDEX_HH
+# define LIBDWARFPP_TYPEINDEX_HH
+
+# include <cstdint>
+# include <memory>
+# include "dwarf.hh"
+# include "span.hh"
+
+namespace Dwarf {
+
+    /*
+     * Type DIEs of all units collapsed by structure, built in one parallel
+     * pass. Each type gets a hash over its tag, scope, name, attributes and
+     * members, recursing through referenced types; a reference that closes
+     * a cycle through a named aggregate or enumeration counts its
+     * qualified name instead. Types with equal hashes, tags and scoped
+     * names share an entry, and declarations share the entry of the
+     * definition of their name when all units agree on it.
+     *
+     * Every type DIE maps to its entry, so per-type data can be kept once
+     * per entry rather than once per unit.
+     */
+    class TypeIndex final {
+    public:
+        struct Entry {
+            uint64_t hash;          // structural hash
+            Dwarf::Off die;         // first DIE of the type, in unit order
+            uint32_t cu;            // unit of die, index in Debug::cu()
+            uint32_t count;         // DIEs collapsed into the entry
+            Dwarf::Half tag;
+        };
+
+        struct Alias {
+            Dwarf::Off die;
+            uint32_t entry;         // index in entries()
+        };
+
+        explicit TypeIndex(const Debug& dbg, unsigned threads = 0);
+
+        /* Index over tables stored elsewhere, e.g. in an index file, which
+         * owner keeps alive. */
+        TypeIndex(Span<const Entry> entries, Span<const Alias> aliases, std::shared_ptr<const void> owner);
+
+        /* Entry of the type DIE at offset, nullptr if it is not a type. */
+        const Entry* find(Dwarf::Off die) const;
+
+        /* Entry with the given structural hash; the first one in the rare
+         * case a hash collision kept several apart. */
+        const Entry* find_hash(uint64_t hash) const;
+
+        /* Whether the tables are consistent with each other and with a
+         * Debug of cu_count units; tables read from a file are checked
+         * before use. */
+        bool valid(size_t cu_count) const;
+
+        /* Unique types. */
+        size_t size() const {
+            return entries_.size();
+        }
+
+        Span<const Entry> entries() const   { return entries_; }   // sorted by hash
+        Span<const Alias> aliases() const   { return aliases_; }   // sorted by DIE offset
+
+    private:
+        struct Tables;
+
+        Span<const Entry> entries_;
+        Span<const Alias> aliases_;
+        std::shared_ptr<const void> owner_;
+    };
+
+}
+
+#endif /* !LIBDWARFPP_TYPEINDEX_HH */
@@ -0,0 +1,100 @@
+/*
+ *  This file is part of libdwarf++.
+ *
+ *  Copyright © 2015 Frankin "Snaipe" Mathieu <http://snaipe.me>
+ *
+ *  libdwarf++ is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libdwarf++ is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libdwarf++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LIBDWARFPP_TYPES_HH
+# define LIBDWARFPP_TYPES_HH
+
+# include <cstdint>
+# include <memory>
+# include <string>
+# include <unordered_map>
+# include <vector>
+# include "dwarf.hh"
+
+namespace Dwarf {
+
+    /*
+     * Memoized view of the types of a Debug. Typedef and qualifier chains
+     * are resolved once per DIE, and the size, alignment and flattened
+     * member layout of each type are computed on first use.
+     *
+     * Types are identified by the offset of their canonical DIE, with 0
+     * standing for void. Not thread-safe.
+     */
+    class TypeResolver final {
+    public:
+        /*
+         * Scalar member of a flattened layout. Members of nested
+         * structures, unions and base classes are inlined at their
+         * absolute offset; arrays are kept whole.
+         */
+        struct Field {
+            Dwarf::Off die;             // DIE of the member
+            Dwarf::Off type;            // canonical type of the member
+            std::string path;           // e.g. "outer.inner.x"
+            uint64_t offset;            // in bytes, from the start of the type
+            uint64_t size;              // in bytes
+            uint16_t bit_offset;        // bitfields only, from offset
+            uint16_t bit_size;          // 0 if not a bitfield
+        };
+
+        struct Type {
+            Dwarf::Off die;
+            Dwarf::Half tag;
+            const char* name;           // nullptr for anonymous types
+            uint64_t size;
+            uint64_t alignment;
+            Dwarf::Off target;          // pointee or element type
+            uint64_t count;             // array elements, 0 if unknown
+            std::vector<Field> fields;  // sorted by offset
+            std::vector<uint64_t> reach; // highest end of fields[0..i]
+        };
+
+        explicit TypeResolver(const Debug& dbg);
+
+        /* Offset of the type behind typedefs and cv/atomic qualifiers. */
+        Dwarf::Off canonical(Dwarf::Off type) const;
+
+        /* Type of a type DIE, canonicalized first; nullptr for void. */
+        const Type* resolve(Dwarf::Off type) const;
+
+        /* Type referenced by the DW_AT_type of die, e.g. a variable or
+         * a parameter; nullptr if it has none. */
+        const Type* type_of(Dwarf::Off die) const;
+
+        /*
+         * Innermost scalar member covering offset bytes into type, found
+         * with a binary search. Where union members overlap, the last
+         * one in declaration order wins. nullptr in padding.
+         */
+        const Field* field_at(const Type& type, uint64_t offset) const;
+
+    private:
+        void layout(Type& type, Die& die) const;
+        void add_member(Type& type, Die& member, bool inheritance) const;
+
+        std::weak_ptr<const Debug> dbg_;
+        Dwarf::Half address_size_;
+        mutable std::unordered_map<Dwarf::Off, Dwarf::Off> canonical_;
+        mutable std::unordered_map<Dwarf::Off, Type> types_;
+    };
+
+}
+
+#endif /* !LIBDWARFPP_TYPES_HH */
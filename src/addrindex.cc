@@ -0,0 +1,461 @@
+/*
+ *  This file is part of libdwarf++.
+ *
+ *  Copyright © 2015 Frankin "Snaipe" Mathieu <http://snaipe.me>
+ *
+ *  libdwarf++ is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libdwarf++ is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libdwarf++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <algorithm>
+#include <tuple>
+#include "libdwarf++/addrindex.hh"
+#include "libdwarf++/cu.hh"
+#include "reader.hh"
+#include "walk.hh"
+
+namespace Dwarf {
+
+    namespace {
+
+        struct Interval {
+            Dwarf::Addr lo;
+            Dwarf::Addr hi;
+            uint32_t depth;
+            uint32_t entry;
+        };
+
+        bool has_code(Dwarf::Half tag) {
+            switch (tag) {
+                case DW_TAG_compile_unit:
+                case DW_TAG_partial_unit:
+                case DW_TAG_subprogram:
+                case DW_TAG_inlined_subroutine:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        bool may_contain_code(Dwarf::Half tag) {
+            switch (tag) {
+                case DW_TAG_compile_unit:
+                case DW_TAG_partial_unit:
+                case DW_TAG_subprogram:
+                case DW_TAG_inlined_subroutine:
+                case DW_TAG_lexical_block:
+                case DW_TAG_namespace:
+                case DW_TAG_module:
+                case DW_TAG_class_type:
+                case DW_TAG_structure_type:
+                case DW_TAG_union_type:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        /* What die_ranges needs to know about the enclosing unit. */
+        struct UnitRanges {
+            Dwarf::Addr base = 0;           // base address for range entries
+            Dwarf::Half version = 0;
+            Dwarf::Half address_size = 0;
+            Dwarf::Half offset_size = 4;    // 8 in 64-bit DWARF
+            Dwarf::Off addr_base = 0;       // DW_AT_addr_base, into .debug_addr
+            Dwarf::Off rnglists_base = 0;   // DW_AT_rnglists_base, into .debug_rnglists
+            Span<const Dwarf::Small> addr;
+            Span<const Dwarf::Small> rnglists;
+        };
+
+        /* Value of an offset or constant attribute of die, if it has it. */
+        bool attr_offset(const Debug& dbg, dwarf::Dwarf_Die die, Dwarf::Half name,
+                         Dwarf::Half* form_out, Dwarf::Unsigned& out) {
+            Error err;
+            dwarf::Dwarf_Attribute attr;
+            switch (dwarf::dwarf_attr(die, name, &attr, &err)) {
+                case DW_DLV_NO_ENTRY: return false;
+                case DW_DLV_ERROR: throw Exception(dbg.shared_from_this(), err);
+                default: break;
+            }
+
+            Dwarf::Half form;
+            int res = dwarf::dwarf_whatform(attr, &form, &err);
+            if (res == DW_DLV_OK) {
+                if (form == DW_FORM_sec_offset) {
+                    Dwarf::Off offset = 0;
+                    res = dwarf::dwarf_global_formref(attr, &offset, &err);
+                    out = offset;
+                } else {
+                    res = dwarf::dwarf_formudata(attr, &out, &err);
+                }
+            }
+            dbg.dealloc(attr);
+            if (res == DW_DLV_ERROR)
+                throw Exception(dbg.shared_from_this(), err);
+            if (form_out)
+                *form_out = form;
+            return true;
+        }
+
+        Dwarf::Addr debug_addr(const UnitRanges& unit, uint64_t index) {
+            Reader r(unit.addr);
+            r.seek(unit.addr_base);
+            if (!unit.address_size || index > unit.addr.size() / unit.address_size)
+                throw std::runtime_error("Truncated DWARF data");
+            r.skip(index * unit.address_size);
+            return r.fixed(unit.address_size);
+        }
+
+        /*
+         * DWARF 5 range list at offset in .debug_rnglists. libdwarf only
+         * reads .debug_ranges, so the entries are decoded here.
+         */
+        template <typename F>
+        void read_rnglist(const UnitRanges& unit, Dwarf::Off offset, F&& out) {
+            Reader r(unit.rnglists);
+            r.seek(offset);
+            Dwarf::Addr base = unit.base;
+            const size_t asz = unit.address_size;
+            for (;;) {
+                Dwarf::Addr lo, hi;
+                switch (r.u8()) {
+                    case DW_RLE_end_of_list:
+                        return;
+                    case DW_RLE_base_addressx:
+                        base = debug_addr(unit, r.uleb());
+                        continue;
+                    case DW_RLE_startx_endx:
+                        lo = debug_addr(unit, r.uleb());
+                        hi = debug_addr(unit, r.uleb());
+                        break;
+                    case DW_RLE_startx_length:
+                        lo = debug_addr(unit, r.uleb());
+                        hi = lo + r.uleb();
+                        break;
+                    case DW_RLE_offset_pair:
+                        lo = base + r.uleb();
+                        hi = base + r.uleb();
+                        break;
+                    case DW_RLE_base_address:
+                        base = r.fixed(asz);
+                        continue;
+                    case DW_RLE_start_end:
+                        lo = r.fixed(asz);
+                        hi = r.fixed(asz);
+                        break;
+                    case DW_RLE_start_length:
+                        lo = r.fixed(asz);
+                        hi = lo + r.uleb();
+                        break;
+                    default:
+                        throw std::runtime_error("Unknown range list entry");
+                }
+                out(lo, hi);
+            }
+        }
+
+        /*
+         * Offset in .debug_rnglists of entry index of the offset table at
+         * rnglists_base, whose entries have the offset size of the unit.
+         */
+        Dwarf::Off rnglist_index(const UnitRanges& unit, uint64_t index) {
+            Reader r(unit.rnglists);
+            const size_t osz = unit.offset_size;
+            r.seek(unit.rnglists_base);
+            if (index > unit.rnglists.size() / osz)
+                throw std::runtime_error("Truncated DWARF data");
+            r.skip(index * osz);
+            return unit.rnglists_base + r.fixed(osz);
+        }
+
+        /*
+         * Appends the pc ranges of die to out, reading DW_AT_ranges from
+         * .debug_ranges or, for DWARF 5 units, .debug_rnglists.
+         */
+        template <typename F>
+        void die_ranges(const Debug& dbg, dwarf::Dwarf_Die die, const UnitRanges& unit, F&& out) {
+            Error err;
+            Dwarf::Addr lo, hi;
+            Dwarf::Half form;
+            enum dwarf::Dwarf_Form_Class cls;
+
+            if (dwarf::dwarf_lowpc(die, &lo, &err) == DW_DLV_OK) {
+                switch (dwarf::dwarf_highpc_b(die, &hi, &form, &cls, &err)) {
+                    case DW_DLV_OK:
+                        if (cls == dwarf::DW_FORM_CLASS_CONSTANT)
+                            hi += lo;
+                        out(lo, hi);
+                        return;
+                    case DW_DLV_ERROR:
+                        throw Exception(dbg.shared_from_this(), err);
+                    default:
+                        // a lone DW_AT_low_pc covers a single address
+                        out(lo, lo + 1);
+                        return;
+                }
+            }
+
+            Dwarf::Unsigned offset;
+            if (!attr_offset(dbg, die, DW_AT_ranges, &form, offset))
+                return;
+
+            if (unit.version >= 5) {
+                if (unit.rnglists.empty())
+                    throw std::runtime_error("DW_AT_ranges without a readable .debug_rnglists");
+                if (form == DW_FORM_rnglistx)
+                    offset = rnglist_index(unit, offset);
+                read_rnglist(unit, offset, out);
+                return;
+            }
+
+            dwarf::Dwarf_Ranges* ranges;
+            Dwarf::Signed count;
+            Dwarf::Unsigned bytes;
+            switch (dwarf::dwarf_get_ranges_a(dbg.get_handle(), offset, die, &ranges, &count, &bytes, &err)) {
+                case DW_DLV_NO_ENTRY: return;
+                case DW_DLV_ERROR: throw Exception(dbg.shared_from_this(), err);
+                default: break;
+            }
+            Dwarf::Addr base = unit.base;
+            for (Dwarf::Signed i = 0; i < count; ++i) {
+                const dwarf::Dwarf_Ranges& r = ranges[i];
+                switch (r.dwr_type) {
+                    case dwarf::DW_RANGES_ENTRY:
+                        out(base + r.dwr_addr1, base + r.dwr_addr2);
+                        break;
+                    case dwarf::DW_RANGES_ADDRESS_SELECTION:
+                        base = r.dwr_addr2;
+                        break;
+                    default:
+                        break;
+                }
+            }
+            dwarf::dwarf_ranges_dealloc(dbg.get_handle(), ranges, count);
+        }
+
+        /*
+         * Flattens properly nested intervals into disjoint segments owned by
+         * the innermost interval. Overlapping siblings are clipped to their
+         * enclosing interval.
+         */
+        std::vector<AddressIndex::Segment> flatten(std::vector<Interval>& intervals) {
+            std::sort(intervals.begin(), intervals.end(), [](const Interval& a, const Interval& b) {
+                return std::make_tuple(a.lo, b.hi, a.depth) < std::make_tuple(b.lo, a.hi, b.depth);
+            });
+
+            std::vector<AddressIndex::Segment> segs;
+            auto emit = [&segs](Dwarf::Addr lo, Dwarf::Addr hi, uint32_t entry) {
+                if (lo >= hi)
+                    return;
+                if (!segs.empty() && segs.back().hi == lo && segs.back().entry == entry)
+                    segs.back().hi = hi;
+                else
+                    segs.push_back({lo, hi, entry});
+            };
+
+            std::vector<Interval> stack;
+            Dwarf::Addr pos = 0;
+            auto pop = [&] {
+                const Interval& top = stack.back();
+                emit(pos, top.hi, top.entry);
+                pos = std::max(pos, top.hi);
+                stack.pop_back();
+            };
+
+            for (Interval cur : intervals) {
+                while (!stack.empty() && stack.back().hi <= cur.lo)
+                    pop();
+                if (!stack.empty()) {
+                    emit(pos, cur.lo, stack.back().entry);
+                    cur.hi = std::min(cur.hi, stack.back().hi);
+                }
+                // the parent is emitted up to cur.lo even if cur is empty
+                pos = cur.lo;
+                if (cur.lo >= cur.hi)
+                    continue;
+                stack.push_back(cur);
+            }
+            while (!stack.empty())
+                pop();
+
+            segs.shrink_to_fit();
+            return segs;
+        }
+
+    }
+
+    struct AddressIndex::Tables {
+        std::vector<Entry> entries;
+        std::vector<Segment> scopes;
+        std::vector<Segment> units;
+    };
+
+    AddressIndex::AddressIndex(const Debug& dbg)
+        : dbg_(dbg.shared_from_this())
+    {
+        auto tables = std::make_shared<Tables>();
+        std::vector<Entry>& entries = tables->entries;
+        std::vector<Interval> scopes;
+        std::vector<Interval> units;
+
+        UnitRanges unit;
+        unit.addr = dbg.raw_section(".debug_addr");
+        unit.rnglists = dbg.raw_section(".debug_rnglists");
+        Span<const Dwarf::Small> info = dbg.raw_section(".debug_info");
+
+        for (size_t cu = 0, count = dbg.cu_count(); cu < count; ++cu) {
+            const CUHeader& header = dbg.cu_header(cu);
+            dwarf::Dwarf_Die root = raw_offdie(dbg, header.die_offset);
+            if (!root)
+                continue;
+
+            Error err;
+            unit.base = 0;
+            unit.version = header.version;
+            unit.address_size = header.address_size;
+            unit.offset_size = unit_offset_size(info, header.offset);
+            unit.addr_base = 0;
+            unit.rnglists_base = 0;
+            try {
+                if (dwarf::dwarf_lowpc(root, &unit.base, &err) == DW_DLV_ERROR)
+                    throw Exception(dbg.shared_from_this(), err);
+                if (unit.version >= 5) {
+                    Dwarf::Unsigned value;
+                    if (attr_offset(dbg, root, DW_AT_addr_base, nullptr, value))
+                        unit.addr_base = value;
+                    // without the attribute, indices refer to the first table,
+                    // past a header of 12 bytes in 32-bit DWARF and 20 in 64
+                    if (attr_offset(dbg, root, DW_AT_rnglists_base, nullptr, value))
+                        unit.rnglists_base = value;
+                    else
+                        unit.rnglists_base = unit.offset_size == 8 ? 20 : 12;
+                }
+            } catch (...) {
+                dbg.dealloc(root);
+                throw;
+            }
+
+            auto visit = [&](dwarf::Dwarf_Die die, unsigned depth) {
+                Dwarf::Half tag;
+                Dwarf::Off offset;
+                if (dwarf::dwarf_tag(die, &tag, &err) == DW_DLV_ERROR)
+                    throw Exception(dbg.shared_from_this(), err);
+
+                if (has_code(tag)) {
+                    if (dwarf::dwarf_dieoffset(die, &offset, &err) == DW_DLV_ERROR)
+                        throw Exception(dbg.shared_from_this(), err);
+
+                    uint32_t entry = static_cast<uint32_t>(entries.size());
+                    bool used = false;
+                    die_ranges(dbg, die, unit, [&](Dwarf::Addr lo, Dwarf::Addr hi) {
+                        if (lo >= hi)
+                            return;
+                        scopes.push_back({lo, hi, depth, entry});
+                        if (depth == 0)
+                            units.push_back({lo, hi, depth, entry});
+                        used = true;
+                    });
+                    if (used)
+                        entries.push_back({offset, tag, static_cast<uint32_t>(cu)});
+                }
+
+                return may_contain_code(tag) ? Die::TraversalResult::TRAVERSE
+                                             : Die::TraversalResult::SKIP;
+            };
+
+            try {
+                walk_dies(dbg, root, visit);
+            } catch (...) {
+                dbg.dealloc(root);
+                throw;
+            }
+            dbg.dealloc(root);
+        }
+
+        entries.shrink_to_fit();
+        tables->scopes = flatten(scopes);
+        tables->units  = flatten(units);
+
+        entries_ = Span<const Entry>(entries.data(), entries.size());
+        scopes_  = Span<const Segment>(tables->scopes.data(), tables->scopes.size());
+        units_   = Span<const Segment>(tables->units.data(), tables->units.size());
+        owner_   = tables;
+    }
+
+    AddressIndex::AddressIndex(const Debug& dbg, Span<const Entry> entries, Span<const Segment> scopes,
+                               Span<const Segment> units, std::shared_ptr<const void> owner)
+        : dbg_(dbg.shared_from_this())
+        , entries_(entries)
+        , scopes_(scopes)
+        , units_(units)
+        , owner_(std::move(owner))
+    {}
+
+    bool AddressIndex::valid(size_t cu_count) const {
+        for (const Entry& e : entries_)
+            if (e.cu >= cu_count)
+                return false;
+
+        // lookups rely on sorted, disjoint, non-empty segments
+        for (Span<const Segment> segs : { scopes_, units_ }) {
+            for (size_t i = 0; i < segs.size(); ++i) {
+                const Segment& s = segs[i];
+                if (s.entry >= entries_.size() || s.lo >= s.hi)
+                    return false;
+                if (i && segs[i - 1].hi > s.lo)
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    const AddressIndex::Entry* AddressIndex::find(Span<const Segment> segs, Dwarf::Addr pc) const {
+        auto it = std::upper_bound(segs.begin(), segs.end(), pc,
+                [](Dwarf::Addr addr, const Segment& s) { return addr < s.lo; });
+        if (it == segs.begin())
+            return nullptr;
+        --it;
+        if (pc >= it->hi)
+            return nullptr;
+        return &entries_[it->entry];
+    }
+
+    const AddressIndex::Entry* AddressIndex::find(Dwarf::Addr pc) const {
+        return find(scopes_, pc);
+    }
+
+    const AddressIndex::Entry* AddressIndex::find_cu(Dwarf::Addr pc) const {
+        return find(units_, pc);
+    }
+
+    std::shared_ptr<AnyDie> AddressIndex::lookup_pc(Dwarf::Addr pc) const {
+        const Entry* e = find(pc);
+        if (!e)
+            return nullptr;
+        std::shared_ptr<const Debug> dbg = dbg_.lock();
+        if (!dbg)
+            throw DebugClosedException();
+        return dbg->offdie(e->die);
+    }
+
+    const CompilationUnit* AddressIndex::lookup_cu(Dwarf::Addr pc) const {
+        const Entry* e = find_cu(pc);
+        if (!e)
+            return nullptr;
+        std::shared_ptr<const Debug> dbg = dbg_.lock();
+        if (!dbg)
+            throw DebugClosedException();
+        return &dbg->cu(e->cu);
+    }
+
+}
@@ -0,0 +1,186 @@
+/*
+ *  This file is part of libdwarf++.
+ *
+ *  Copyright © 2015 Frankin "Snaipe" Mathieu <http://snaipe.me>
+ *
+ *  libdwarf++ is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libdwarf++ is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libdwarf++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <cstring>
+#include "libdwarf++/attributes.hh"
+#include "libdwarf++/dwarf.hh"
+
+namespace Dwarf {
+
+    static int decode_attribute(const Debug& dbg, dwarf::Dwarf_Attribute attr, AttributeEntry& e, Error* err) {
+        e.value = AttributeValue();
+
+        int res;
+        if ((res = dwarf::dwarf_whatattr(attr, &e.name, err)) != DW_DLV_OK)
+            return res;
+        if ((res = dwarf::dwarf_whatform(attr, &e.form, err)) != DW_DLV_OK)
+            return res;
+
+        switch (e.form) {
+            case DW_FORM_data1:
+            case DW_FORM_data2:
+            case DW_FORM_data4:
+            case DW_FORM_data8:
+            case DW_FORM_udata: {
+                Dwarf::Unsigned v;
+                if ((res = dwarf::dwarf_formudata(attr, &v, err)) == DW_DLV_OK)
+                    e.value = AttributeValue::make_unsigned(v);
+                return res;
+            }
+            case DW_FORM_data16: {
+                dwarf::Dwarf_Form_Data16 v;
+                if ((res = dwarf::dwarf_formdata16(attr, &v, err)) == DW_DLV_OK)
+                    e.value = AttributeValue::make_data16(v.fd_data);
+                return res;
+            }
+            case DW_FORM_rnglistx:
+            case DW_FORM_loclistx: {
+                Dwarf::Unsigned v;
+                if ((res = dwarf::dwarf_formudata(attr, &v, err)) == DW_DLV_OK)
+                    e.value = AttributeValue::make_index(v);
+                return res;
+            }
+            case DW_FORM_implicit_const:
+            case DW_FORM_sdata: {
+                Dwarf::Signed v;
+                if ((res = dwarf::dwarf_formsdata(attr, &v, err)) == DW_DLV_OK)
+                    e.value = AttributeValue::make_signed(v);
+                return res;
+            }
+            case DW_FORM_addr:
+            case DW_FORM_addrx:
+            case DW_FORM_addrx1:
+            case DW_FORM_addrx2:
+            case DW_FORM_addrx3:
+            case DW_FORM_addrx4:
+            case DW_FORM_GNU_addr_index: {
+                Dwarf::Addr v;
+                if ((res = dwarf::dwarf_formaddr(attr, &v, err)) == DW_DLV_OK)
+                    e.value = AttributeValue::make_address(v);
+                return res;
+            }
+            case DW_FORM_ref1:
+            case DW_FORM_ref2:
+            case DW_FORM_ref4:
+            case DW_FORM_ref8:
+            case DW_FORM_ref_udata:
+            case DW_FORM_ref_addr: {
+                Dwarf::Off v;
+                if ((res = dwarf::dwarf_global_formref(attr, &v, err)) == DW_DLV_OK)
+                    e.value = AttributeValue::make_reference(v);
+                return res;
+            }
+            case DW_FORM_ref_sig8: {
+                // refers to a type unit, not to an offset
+                dwarf::Dwarf_Sig8 sig;
+                uint64_t v;
+                if ((res = dwarf::dwarf_formsig8(attr, &sig, err)) == DW_DLV_OK) {
+                    std::memcpy(&v, sig.signature, sizeof (v));
+                    e.value = AttributeValue::make_signature(v);
+                }
+                return res;
+            }
+            case DW_FORM_sec_offset: {
+                Dwarf::Off v;
+                if ((res = dwarf::dwarf_global_formref(attr, &v, err)) == DW_DLV_OK)
+                    e.value = AttributeValue::make_section_offset(v);
+                return res;
+            }
+            case DW_FORM_string:
+            case DW_FORM_strp:
+            case DW_FORM_strx:
+            case DW_FORM_strx1:
+            case DW_FORM_strx2:
+            case DW_FORM_strx3:
+            case DW_FORM_strx4:
+            case DW_FORM_line_strp:
+            case DW_FORM_strp_sup:
+            case DW_FORM_GNU_strp_alt:
+            case DW_FORM_GNU_str_index: {
+                char* str = nullptr;
+                if ((res = dwarf::dwarf_formstring(attr, &str, err)) == DW_DLV_OK)
+                    e.value = AttributeValue::make_string(str);
+                return res;
+            }
+            case DW_FORM_flag:
+            case DW_FORM_flag_present: {
+                Dwarf::Bool v;
+                if ((res = dwarf::dwarf_formflag(attr, &v, err)) == DW_DLV_OK)
+                    e.value = AttributeValue::make_flag(v);
+                return res;
+            }
+            case DW_FORM_block1:
+            case DW_FORM_block2:
+            case DW_FORM_block4:
+            case DW_FORM_block: {
+                // only the descriptor is allocated, the bytes live in the
+                // section: keep a view and drop the descriptor
+                Dwarf::Block* block = nullptr;
+                if ((res = dwarf::dwarf_formblock(attr, &block, err)) != DW_DLV_OK)
+                    return res;
+                e.value = AttributeValue::make_bytes(AttributeValue::BLOCK, block->bl_data, block->bl_len);
+                dbg.dealloc(block);
+                return DW_DLV_OK;
+            }
+            case DW_FORM_exprloc: {
+                Dwarf::Unsigned len;
+                Dwarf::Ptr data = nullptr;
+                if ((res = dwarf::dwarf_formexprloc(attr, &len, &data, err)) == DW_DLV_OK)
+                    e.value = AttributeValue::make_bytes(AttributeValue::EXPRLOC, data, len);
+                return res;
+            }
+            default:
+                // keep the attribute visible, and say why it has no value
+                e.value = AttributeValue::make_unsupported(e.form);
+                return DW_DLV_OK;
+        }
+    }
+
+    void AttributeList::load(const Debug& dbg, dwarf::Dwarf_Die die) {
+        if (loaded_)
+            return;
+
+        dwarf::Dwarf_Attribute* attrs;
+        Dwarf::Signed count;
+        Error err;
+        switch (dwarf::dwarf_attrlist(die, &attrs, &count, &err)) {
+            case DW_DLV_ERROR: throw Exception(dbg.shared_from_this(), err);
+            case DW_DLV_NO_ENTRY: count = 0; break;
+            default: break;
+        }
+
+        entries_.clear();
+        entries_.reserve(static_cast<size_t>(count));
+
+        for (Dwarf::Signed i = 0; i < count; ++i) {
+            AttributeEntry e;
+            switch (decode_attribute(dbg, attrs[i], e, &err)) {
+                case DW_DLV_OK: entries_.push_back(e); break;
+                case DW_DLV_ERROR: dbg.dealloc(err); break;
+                default: break;
+            }
+            dbg.dealloc(attrs[i]);
+        }
+        if (count > 0)
+            dbg.dealloc(attrs);
+
+        loaded_ = true;
+    }
+
+}
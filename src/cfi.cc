@@ -0,0 +1,455 @@
+/*
+ *  This file is part of libdwarf++.
+ *
+ *  Copyright © 2015 Frankin "Snaipe" Mathieu <http://snaipe.me>
+ *
+ *  libdwarf++ is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libdwarf++ is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libdwarf++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include "libdwarf++/cfi.hh"
+#include "libdwarf++/dwarf.hh"
+#include "reader.hh"
+
+namespace Dwarf {
+
+    constexpr size_t Registers::count;
+    constexpr Dwarf::Half Registers::none;
+    constexpr uint32_t CallFrameInfo::CFARule::no_expr;
+
+    namespace {
+
+        struct State {
+            CallFrameInfo::CFARule cfa;
+            std::vector<CallFrameInfo::RegisterRule> rules;     // sorted by register
+
+            void set(Dwarf::Half reg, CallFrameInfo::Rule rule) {
+                auto it = std::lower_bound(rules.begin(), rules.end(), reg,
+                        [](const CallFrameInfo::RegisterRule& r, Dwarf::Half reg) {
+                            return r.reg < reg;
+                        });
+                if (it != rules.end() && it->reg == reg)
+                    it->rule = rule;
+                else
+                    rules.insert(it, CallFrameInfo::RegisterRule { reg, rule });
+            }
+
+            void restore(Dwarf::Half reg, const State& initial) {
+                auto match = [reg](const CallFrameInfo::RegisterRule& r) {
+                    return r.reg == reg;
+                };
+                auto init = std::find_if(initial.rules.begin(), initial.rules.end(), match);
+                if (init != initial.rules.end()) {
+                    set(reg, init->rule);
+                } else {
+                    auto it = std::find_if(rules.begin(), rules.end(), match);
+                    if (it != rules.end())
+                        rules.erase(it);
+                }
+            }
+        };
+
+        bool same_rules(const std::vector<CallFrameInfo::RegisterRule>& a,
+                        const CallFrameInfo::RegisterRule* b, size_t count) {
+            if (a.size() != count)
+                return false;
+            for (size_t i = 0; i < count; ++i)
+                if (a[i].reg != b[i].reg || a[i].rule.kind != b[i].rule.kind || a[i].rule.value != b[i].rule.value)
+                    return false;
+            return true;
+        }
+
+        uint64_t location_value(const Location& loc) {
+            if (loc.pieces.size() != 1
+                    || (loc.pieces[0].kind != Piece::MEMORY && loc.pieces[0].kind != Piece::VALUE))
+                throw std::runtime_error("Call frame expression does not compute a value");
+            return loc.pieces[0].value;
+        }
+
+    }
+
+    CallFrameInfo::CallFrameInfo(const Debug& dbg)
+        : address_size_(dbg.address_size())
+    {
+        load(dbg, dwarf::dwarf_get_fde_list);
+        load(dbg, dwarf::dwarf_get_fde_list_eh);
+
+        // .debug_frame was loaded first and wins over .eh_frame for
+        // functions described in both
+        std::stable_sort(fdes_.begin(), fdes_.end(), [](const FDE& a, const FDE& b) {
+            return a.lo < b.lo;
+        });
+        fdes_.erase(std::unique(fdes_.begin(), fdes_.end(), [](const FDE& a, const FDE& b) {
+            return a.lo == b.lo;
+        }), fdes_.end());
+
+        tables_.resize(fdes_.size());
+    }
+
+    void CallFrameInfo::load(const Debug& dbg, ListFunction list) {
+        dwarf::Dwarf_Cie* cies;
+        dwarf::Dwarf_Fde* fdes;
+        Dwarf::Signed cie_count, fde_count;
+        Error err;
+        switch (list(dbg.get_handle(), &cies, &cie_count, &fdes, &fde_count, &err)) {
+            case DW_DLV_ERROR: throw Exception(dbg.shared_from_this(), err);
+            case DW_DLV_NO_ENTRY: return;
+            default: break;
+        }
+
+        const uint32_t cie_base = static_cast<uint32_t>(cies_.size());
+        int res = DW_DLV_OK;
+
+        for (Dwarf::Signed i = 0; i < cie_count && res != DW_DLV_ERROR; ++i) {
+            Dwarf::Unsigned size, code_align, init_len;
+            Dwarf::Small version;
+            char* augmenter;
+            Dwarf::Signed data_align;
+            Dwarf::Half ra;
+            Dwarf::Ptr init;
+            res = dwarf::dwarf_get_cie_info(cies[i], &size, &version, &augmenter, &code_align,
+                    &data_align, &ra, &init, &init_len, &err);
+            if (res == DW_DLV_OK)
+                cies_.push_back(CIE { code_align, data_align, ra,
+                        augmenter && std::strchr(augmenter, 'S') != nullptr,
+                        Span<const Dwarf::Small>(static_cast<const Dwarf::Small*>(init), init_len) });
+        }
+
+        for (Dwarf::Signed i = 0; i < fde_count && res != DW_DLV_ERROR; ++i) {
+            Dwarf::Addr lo;
+            Dwarf::Unsigned len, fde_len, instr_len;
+            Dwarf::Ptr fde_bytes, instrs;
+            Dwarf::Off cie_off, fde_off;
+            Dwarf::Signed cie_index;
+            res = dwarf::dwarf_get_fde_range(fdes[i], &lo, &len, &fde_bytes, &fde_len,
+                    &cie_off, &cie_index, &fde_off, &err);
+            if (res == DW_DLV_OK)
+                res = dwarf::dwarf_get_fde_instr_bytes(fdes[i], &instrs, &instr_len, &err);
+            if (res == DW_DLV_OK && len > 0)
+                fdes_.push_back(FDE { lo, lo + len,
+                        Span<const Dwarf::Small>(static_cast<const Dwarf::Small*>(instrs), instr_len),
+                        cie_base + static_cast<uint32_t>(cie_index) });
+        }
+
+        dwarf::dwarf_fde_cie_list_dealloc(dbg.get_handle(), cies, cie_count, fdes, fde_count);
+        if (res == DW_DLV_ERROR)
+            throw Exception(dbg.shared_from_this(), err);
+    }
+
+    const CallFrameInfo::FDE* CallFrameInfo::find_fde(Dwarf::Addr pc) const {
+        auto it = std::upper_bound(fdes_.begin(), fdes_.end(), pc, [](Dwarf::Addr pc, const FDE& f) {
+            return pc < f.lo;
+        });
+        if (it == fdes_.begin())
+            return nullptr;
+        --it;
+        return pc < it->hi ? &*it : nullptr;
+    }
+
+    const CallFrameInfo::Table* CallFrameInfo::table(Dwarf::Addr pc) const {
+        const FDE* fde = find_fde(pc);
+        if (!fde)
+            return nullptr;
+
+        std::unique_ptr<const Table>& slot = tables_[fde - fdes_.data()];
+        if (!slot)
+            slot = build(*fde);
+        return slot.get();
+    }
+
+    const CallFrameInfo::Row* CallFrameInfo::find_row(Dwarf::Addr pc) const {
+        const Table* t = table(pc);
+        return t ? t->find(pc) : nullptr;
+    }
+
+    const CallFrameInfo::Row* CallFrameInfo::Table::find(Dwarf::Addr pc) const {
+        auto it = std::upper_bound(rows.begin(), rows.end(), pc, [](Dwarf::Addr pc, const Row& r) {
+            return pc < r.lo;
+        });
+        if (it == rows.begin())
+            return nullptr;
+        --it;
+        return pc < it->hi ? &*it : nullptr;
+    }
+
+    std::unique_ptr<const CallFrameInfo::Table> CallFrameInfo::build(const FDE& fde) const {
+        const CIE& cie = cies_.at(fde.cie);
+        std::unique_ptr<Table> table(new Table);
+        table->return_address = cie.return_address;
+        table->signal_frame = cie.signal_frame;
+
+        Dwarf::Addr loc = fde.lo;
+
+        auto emit = [&](const State& st, Dwarf::Addr end) {
+            if (end <= loc)
+                return;
+
+            Row row = { loc, end, st.cfa, static_cast<uint32_t>(table->rules.size()),
+                        static_cast<uint32_t>(st.rules.size()) };
+            if (!table->rows.empty()) {
+                const Row& prev = table->rows.back();
+                if (same_rules(st.rules, table->rules.data() + prev.first_rule, prev.rule_count))
+                    row.first_rule = prev.first_rule;
+            }
+            if (row.first_rule == table->rules.size())
+                table->rules.insert(table->rules.end(), st.rules.begin(), st.rules.end());
+
+            table->rows.push_back(row);
+            loc = end;
+        };
+
+        auto compile = [&](Span<const Dwarf::Small> block, bool push_cfa) {
+            // register rule expressions start with the CFA on the stack
+            std::vector<Dwarf::Small> code;
+            if (push_cfa)
+                code.push_back(DW_OP_call_frame_cfa);
+            code.insert(code.end(), block.begin(), block.end());
+            table->code_.push_back(std::move(code));
+
+            const std::vector<Dwarf::Small>& stored = table->code_.back();
+            table->exprs.emplace_back(Span<const Dwarf::Small>(stored.data(), stored.size()), address_size_);
+            return static_cast<int64_t>(table->exprs.size() - 1);
+        };
+
+        auto run = [&](Span<const Dwarf::Small> instrs, State& st, const State& initial, bool emit_rows) {
+            std::vector<State> saved;
+            Reader r(instrs);
+
+            auto advance = [&](Dwarf::Addr to) {
+                if (emit_rows)
+                    emit(st, to);
+            };
+
+            while (!r.done()) {
+                Dwarf::Small op = r.u8();
+                Dwarf::Small low = op & 0x3f;
+
+                switch (op & 0xc0) {
+                    case DW_CFA_advance_loc:
+                        advance(loc + low * cie.code_align);
+                        continue;
+                    case DW_CFA_offset:
+                        st.set(low, Rule { Rule::OFFSET, static_cast<int64_t>(r.uleb()) * cie.data_align });
+                        continue;
+                    case DW_CFA_restore:
+                        st.restore(low, initial);
+                        continue;
+                    default: break;
+                }
+
+                switch (op) {
+                    case DW_CFA_nop:
+                        break;
+                    case DW_CFA_set_loc:
+                        // pointer encodings from .eh_frame augmentations are
+                        // not applied; producers do not emit set_loc there
+                        advance(r.fixed(address_size_));
+                        break;
+                    case DW_CFA_advance_loc1:
+                        advance(loc + r.fixed(1) * cie.code_align);
+                        break;
+                    case DW_CFA_advance_loc2:
+                        advance(loc + r.fixed(2) * cie.code_align);
+                        break;
+                    case DW_CFA_advance_loc4:
+                        advance(loc + r.fixed(4) * cie.code_align);
+                        break;
+
+                    case DW_CFA_offset_extended: {
+                        Dwarf::Half reg = r.uleb();
+                        st.set(reg, Rule { Rule::OFFSET, static_cast<int64_t>(r.uleb()) * cie.data_align });
+                    } break;
+                    case DW_CFA_offset_extended_sf: {
+                        Dwarf::Half reg = r.uleb();
+                        st.set(reg, Rule { Rule::OFFSET, r.sleb() * cie.data_align });
+                    } break;
+                    case DW_CFA_GNU_negative_offset_extended: {
+                        Dwarf::Half reg = r.uleb();
+                        st.set(reg, Rule { Rule::OFFSET, -static_cast<int64_t>(r.uleb()) * cie.data_align });
+                    } break;
+                    case DW_CFA_val_offset: {
+                        Dwarf::Half reg = r.uleb();
+                        st.set(reg, Rule { Rule::VAL_OFFSET, static_cast<int64_t>(r.uleb()) * cie.data_align });
+                    } break;
+                    case DW_CFA_val_offset_sf: {
+                        Dwarf::Half reg = r.uleb();
+                        st.set(reg, Rule { Rule::VAL_OFFSET, r.sleb() * cie.data_align });
+                    } break;
+                    case DW_CFA_restore_extended:
+                        st.restore(r.uleb(), initial);
+                        break;
+                    case DW_CFA_undefined:
+                        st.set(r.uleb(), Rule { Rule::UNDEFINED, 0 });
+                        break;
+                    case DW_CFA_same_value:
+                        st.set(r.uleb(), Rule { Rule::SAME_VALUE, 0 });
+                        break;
+                    case DW_CFA_register: {
+                        Dwarf::Half reg = r.uleb();
+                        st.set(reg, Rule { Rule::REGISTER, static_cast<int64_t>(r.uleb()) });
+                    } break;
+                    case DW_CFA_expression:
+                    case DW_CFA_val_expression: {
+                        Dwarf::Half reg = r.uleb();
+                        size_t len = r.uleb();
+                        Span<const Dwarf::Small> block(r.here(), len);
+                        r.skip(len);
+                        st.set(reg, Rule { op == DW_CFA_expression ? Rule::EXPRESSION : Rule::VAL_EXPRESSION,
+                                           compile(block, true) });
+                    } break;
+
+                    case DW_CFA_remember_state:
+                        saved.push_back(st);
+                        break;
+                    case DW_CFA_restore_state:
+                        if (saved.empty())
+                            throw std::runtime_error("Unbalanced DW_CFA_restore_state");
+                        st = std::move(saved.back());
+                        saved.pop_back();
+                        break;
+
+                    case DW_CFA_def_cfa:
+                        st.cfa.reg = r.uleb();
+                        st.cfa.offset = r.uleb();
+                        st.cfa.expr = CFARule::no_expr;
+                        break;
+                    case DW_CFA_def_cfa_sf:
+                        st.cfa.reg = r.uleb();
+                        st.cfa.offset = r.sleb() * cie.data_align;
+                        st.cfa.expr = CFARule::no_expr;
+                        break;
+                    case DW_CFA_def_cfa_register:
+                        st.cfa.reg = r.uleb();
+                        st.cfa.expr = CFARule::no_expr;
+                        break;
+                    case DW_CFA_def_cfa_offset:
+                        st.cfa.offset = r.uleb();
+                        break;
+                    case DW_CFA_def_cfa_offset_sf:
+                        st.cfa.offset = r.sleb() * cie.data_align;
+                        break;
+                    case DW_CFA_def_cfa_expression: {
+                        size_t len = r.uleb();
+                        Span<const Dwarf::Small> block(r.here(), len);
+                        r.skip(len);
+                        st.cfa.expr = static_cast<uint32_t>(compile(block, false));
+                    } break;
+
+                    case DW_CFA_GNU_args_size:
+                        r.uleb();
+                        break;
+                    case DW_CFA_GNU_window_save:
+                        break;
+
+                    default: throw std::runtime_error("Unknown call frame instruction");
+                }
+            }
+        };
+
+        State initial = { CFARule { 0, 0, CFARule::no_expr }, {} };
+        run(cie.initial_instructions, initial, initial, false);
+
+        State st = initial;
+        run(fde.instructions, st, initial, true);
+        emit(st, fde.hi);
+
+        return table;
+    }
+
+    bool CallFrameInfo::unwind_step(Registers& regs, const MemoryReader& read_memory) const {
+        if (!read_memory)
+            throw std::invalid_argument("unwind_step needs a memory reader");
+
+        Dwarf::Addr pc = regs.return_address ? regs.pc - 1 : regs.pc;
+        const Table* t = table(pc);
+        const Row* row = t ? t->find(pc) : nullptr;
+        if (!row)
+            return false;
+
+        auto read = [&](uint64_t addr) {
+            return read_memory(addr, address_size_);
+        };
+        auto reg = [&](uint64_t n) {
+            if (n >= Registers::count)
+                throw std::runtime_error("Register out of range in call frame information");
+            return regs.values[n];
+        };
+
+        Expression::Context ctx;
+        ctx.registers = Span<const uint64_t>(regs.values, Registers::count);
+        ctx.read_memory = read_memory;
+
+        uint64_t cfa;
+        if (row->cfa.expr == CFARule::no_expr)
+            cfa = reg(row->cfa.reg) + row->cfa.offset;
+        else
+            cfa = location_value(t->exprs[row->cfa.expr].evaluate(ctx));
+        ctx.cfa = [cfa]() { return cfa; };
+
+        uint64_t next[Registers::count];
+        std::memcpy(next, regs.values, sizeof (next));
+        bool has_caller = t->return_address < Registers::count;
+
+        for (const RegisterRule& r : t->rules_of(*row)) {
+            if (r.reg >= Registers::count)
+                continue;
+            switch (r.rule.kind) {
+                case Rule::UNDEFINED:
+                    next[r.reg] = 0;
+                    if (r.reg == t->return_address)
+                        has_caller = false;
+                    break;
+                case Rule::SAME_VALUE:
+                    break;
+                case Rule::OFFSET:
+                    next[r.reg] = read(cfa + r.rule.value);
+                    break;
+                case Rule::VAL_OFFSET:
+                    next[r.reg] = cfa + r.rule.value;
+                    break;
+                case Rule::REGISTER:
+                    next[r.reg] = reg(r.rule.value);
+                    break;
+                case Rule::EXPRESSION:
+                    next[r.reg] = read(location_value(t->exprs[r.rule.value].evaluate(ctx)));
+                    break;
+                case Rule::VAL_EXPRESSION:
+                    next[r.reg] = location_value(t->exprs[r.rule.value].evaluate(ctx));
+                    break;
+            }
+        }
+
+        if (!has_caller)
+            return false;
+
+        std::memcpy(regs.values, next, sizeof (next));
+        if (regs.sp < Registers::count)
+            regs.values[regs.sp] = cfa;
+        regs.cfa = cfa;
+        regs.pc = next[t->return_address];
+        // a signal frame saved the pc of the interrupted instruction, which
+        // has not started yet: its row is looked up at the pc itself
+        regs.return_address = !t->signal_frame;
+        return regs.pc != 0;
+    }
+
+    const CallFrameInfo& Debug::call_frame_info() const {
+        if (!cfi_)
+            cfi_ = std::make_shared<CallFrameInfo>(*this);
+        return *cfi_;
+    }
+
+}
@@ -0,0 +1,275 @@
+/*
+ *  This file is part of libdwarf++.
+ *
+ *  Copyright © 2015 Frankin "Snaipe" Mathieu <http://snaipe.me>
+ *
+ *  libdwarf++ is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libdwarf++ is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libdwarf++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "compress.hh"
+#include "parallel.hh"
+
+namespace Dwarf {
+
+    bool find_compressed(const ElfImage& elf, size_t index, CompressedSection& out) {
+        const ElfImage::Section& s = elf.section(index);
+        if (s.type == SHT_NOBITS)
+            return false;
+
+        Span<const Dwarf::Small> data = elf.data(index);
+        out.index = index;
+        out.checksum = 0;
+
+        if (s.flags & SHF_COMPRESSED) {
+            uint32_t type;
+            size_t header;
+            if (elf.is64()) {
+                type = elf.read<uint32_t>(s.offset + offsetof(Elf64_Chdr, ch_type));
+                out.size = elf.read<uint64_t>(s.offset + offsetof(Elf64_Chdr, ch_size));
+                header = sizeof (Elf64_Chdr);
+            } else {
+                type = elf.read<uint32_t>(s.offset + offsetof(Elf32_Chdr, ch_type));
+                out.size = elf.read<uint32_t>(s.offset + offsetof(Elf32_Chdr, ch_size));
+                header = sizeof (Elf32_Chdr);
+            }
+            if (type != ELFCOMPRESS_ZLIB || data.size() < header)
+                return false;
+            out.name = s.name;
+            out.payload = data.subspan(header, data.size() - header);
+            return true;
+        }
+
+        // legacy GNU format: "ZLIB" and the big-endian decompressed size
+        if (std::strncmp(s.name, ".zdebug_", 8) == 0 && data.size() >= 12
+                && std::memcmp(data.data(), "ZLIB", 4) == 0) {
+            out.size = 0;
+            for (size_t i = 4; i < 12; ++i)
+                out.size = (out.size << 8) | data[i];
+            out.name = std::string(".") + (s.name + 2);
+            out.payload = data.subspan(12, data.size() - 12);
+            return true;
+        }
+        return false;
+    }
+
+    uint32_t checksum(Span<const Dwarf::Small> bytes) {
+        uLong crc = crc32(0, Z_NULL, 0);
+        const Dwarf::Small* p = bytes.data();
+        size_t left = bytes.size();
+        while (left) {
+            uInt n = static_cast<uInt>(std::min<size_t>(left, 1u << 30));
+            crc = crc32(crc, p, n);
+            p += n;
+            left -= n;
+        }
+        return static_cast<uint32_t>(crc);
+    }
+
+    static void inflate_into(const CompressedSection& section, Dwarf::Small* out) {
+        z_stream zs;
+        std::memset(&zs, 0, sizeof (zs));
+        if (inflateInit(&zs) != Z_OK)
+            throw std::runtime_error("Could not initialize zlib");
+
+        // avail_in/avail_out are 32-bit, feed large sections in chunks
+        const uInt chunk = 1u << 30;
+        const Dwarf::Small* in = section.payload.data();
+        size_t in_left = section.payload.size();
+        size_t out_left = section.size;
+        zs.next_out = out;
+
+        int res = Z_OK;
+        while (res == Z_OK) {
+            if (zs.avail_in == 0 && in_left) {
+                zs.next_in = const_cast<Dwarf::Small*>(in);
+                zs.avail_in = static_cast<uInt>(std::min<size_t>(in_left, chunk));
+                in += zs.avail_in;
+                in_left -= zs.avail_in;
+            }
+            if (zs.avail_out == 0 && out_left) {
+                zs.avail_out = static_cast<uInt>(std::min<size_t>(out_left, chunk));
+                out_left -= zs.avail_out;
+            }
+            res = inflate(&zs, Z_NO_FLUSH);
+        }
+        const bool complete = res == Z_STREAM_END && zs.total_out == section.size;
+        inflateEnd(&zs);
+
+        if (!complete)
+            throw std::runtime_error(std::string("Could not decompress ") + section.name);
+    }
+
+    void decompress(std::vector<CompressedSection*>& sections, unsigned threads) {
+        std::sort(sections.begin(), sections.end(), [](const CompressedSection* a, const CompressedSection* b) {
+            return a->size > b->size;
+        });
+
+        threads = static_cast<unsigned>(std::min<size_t>(worker_count(threads), sections.size()));
+
+        std::atomic<size_t> next(0);
+        std::exception_ptr failure;
+        std::mutex failure_lock;
+
+        auto work = [&] {
+            for (size_t i; (i = next++) < sections.size(); ) {
+                CompressedSection& s = *sections[i];
+                try {
+                    std::shared_ptr<Dwarf::Small> buf(new Dwarf::Small[s.size], std::default_delete<Dwarf::Small[]>());
+                    inflate_into(s, buf.get());
+                    s.data = Span<const Dwarf::Small>(buf.get(), s.size);
+                    s.owner = buf;
+                } catch (...) {
+                    std::lock_guard<std::mutex> guard(failure_lock);
+                    if (!failure)
+                        failure = std::current_exception();
+                }
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for (unsigned i = 1; i < threads; ++i)
+            workers.emplace_back(work);
+        work();
+        for (std::thread& t : workers)
+            t.join();
+
+        if (failure)
+            std::rethrow_exception(failure);
+    }
+
+    SectionCache::SectionCache(const std::string& dir, Span<const Dwarf::Small> build_id, bool verify)
+        : verify_(verify)
+    {
+        if (dir.empty() || build_id.empty())
+            return;
+
+        ::mkdir(dir.c_str(), 0755);
+        std::string sub = dir + "/" + to_hex(build_id);
+        if (::mkdir(sub.c_str(), 0755) == -1 && errno != EEXIST)
+            return;
+        dir_ = sub;
+    }
+
+    std::string SectionCache::path(const CompressedSection& section) const {
+        char checksum[16];
+        std::snprintf(checksum, sizeof (checksum), "%08x", section.checksum);
+        return dir_ + "/" + (section.name.c_str() + 1) + "-" + checksum;
+    }
+
+    namespace {
+
+        /* Ends every cache entry. An entry is only used if its trailer
+         * matches its size and the crc32 of its bytes. */
+        struct Trailer {
+            char magic[8];
+            uint64_t size;
+            uint32_t crc;
+            uint32_t reserved;
+        };
+
+        const char trailer_magic[8] = { 'D', 'W', 'P', 'P', 'S', 'E', 'C', '\0' };
+
+        bool write_all(int fd, const void* data, size_t size) {
+            const char* p = static_cast<const char*>(data);
+            while (size) {
+                ssize_t n = ::write(fd, p, size);
+                if (n == -1 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                    return false;
+                p += n;
+                size -= static_cast<size_t>(n);
+            }
+            return true;
+        }
+
+    }
+
+    bool SectionCache::load(CompressedSection& section) const {
+        if (!enabled() || section.size == 0)
+            return false;
+
+        int fd = ::open(path(section).c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1)
+            return false;
+
+        const size_t size = section.size + sizeof (Trailer);
+        struct stat st;
+        void* map = MAP_FAILED;
+        if (::fstat(fd, &st) == 0 && static_cast<uint64_t>(st.st_size) == size)
+            map = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED)
+            return false;
+
+        Span<const Dwarf::Small> data(static_cast<const Dwarf::Small*>(map), section.size);
+        Trailer t;
+        std::memcpy(&t, data.data() + section.size, sizeof (t));
+        if (std::memcmp(t.magic, trailer_magic, sizeof (t.magic)) != 0
+                || t.size != section.size || (verify_ && t.crc != checksum(data))) {
+            ::munmap(map, size);
+            return false;
+        }
+
+        section.data = data;
+        section.owner = std::shared_ptr<const void>(map, [size](const void* p) {
+            ::munmap(const_cast<void*>(p), size);
+        });
+        return true;
+    }
+
+    void SectionCache::store(const CompressedSection& section) const {
+        if (!enabled())
+            return;
+
+        // write aside under a unique name and rename, so readers never see
+        // a partial entry and concurrent writers never share a file
+        const std::string final_path = path(section);
+        std::vector<char> tmp(final_path.begin(), final_path.end());
+        const char suffix[] = ".tmp.XXXXXX";
+        tmp.insert(tmp.end(), suffix, suffix + sizeof (suffix));
+        int fd = ::mkstemp(tmp.data());
+        if (fd == -1)
+            return;
+        ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+        ::fchmod(fd, 0644);
+
+        Trailer t;
+        std::memset(&t, 0, sizeof (t));
+        std::memcpy(t.magic, trailer_magic, sizeof (t.magic));
+        t.size = section.data.size();
+        t.crc = checksum(section.data);
+
+        bool ok = write_all(fd, section.data.data(), section.data.size())
+               && write_all(fd, &t, sizeof (t));
+        ok = ::close(fd) == 0 && ok;
+
+        if (!ok || ::rename(tmp.data(), final_path.c_str()) == -1)
+            ::unlink(tmp.data());
+    }
+
+}
@@ -0,0 +1,86 @@
+/*
+ *  This file is part of libdwarf++.
+ *
+ *  Copyright © 2015 Frankin "Snaipe" Mathieu <http://snaipe.me>
+ *
+ *  libdwarf++ is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libdwarf++ is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libdwarf++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LIBDWARFPP_COMPRESS_HH
+# define LIBDWARFPP_COMPRESS_HH
+
+# include <memory>
+# include <string>
+# include <vector>
+# include "elf.hh"
+
+namespace Dwarf {
+
+    /* A zlib compressed section, SHF_COMPRESSED or legacy .zdebug_*. */
+    struct CompressedSection {
+        size_t index;
+        std::string name;                   // name once decompressed
+        Span<const Dwarf::Small> payload;   // zlib stream
+        uint64_t size;                      // decompressed size
+        uint32_t checksum;                  // crc32 of the payload, once computed
+
+        Span<const Dwarf::Small> data;      // decompressed bytes
+        std::shared_ptr<const void> owner;  // keeps data alive
+    };
+
+    /* crc32 of bytes. */
+    uint32_t checksum(Span<const Dwarf::Small> bytes);
+
+    /* Describes section index of elf if it is compressed with zlib. */
+    bool find_compressed(const ElfImage& elf, size_t index, CompressedSection& out);
+
+    /*
+     * Decompresses every section, spread over threads workers (0 means
+     * one per hardware thread). A zlib stream can only be inflated from
+     * its start, so the unit of work is a whole section; the largest ones
+     * are handed out first.
+     */
+    void decompress(std::vector<CompressedSection*>& sections, unsigned threads);
+
+    /*
+     * On-disk cache of decompressed sections. Entries live under
+     * dir/<build-id>/ and are named after the section and the checksum of
+     * its compressed payload, so a rebuilt binary never matches a stale
+     * entry. Each entry ends with a trailer holding its size and the crc32
+     * of the decompressed bytes. Hits are mapped rather than read: only
+     * the size and trailer are checked, unless verify asks for the crc32
+     * too, which reads the whole entry.
+     */
+    class SectionCache {
+    public:
+        /* The cache is disabled if dir or build_id is empty. */
+        SectionCache(const std::string& dir, Span<const Dwarf::Small> build_id, bool verify = false);
+
+        bool enabled() const {
+            return !dir_.empty();
+        }
+
+        bool load(CompressedSection& section) const;
+        void store(const CompressedSection& section) const;
+
+    private:
+        std::string path(const CompressedSection& section) const;
+
+        std::string dir_;
+        bool verify_;
+    };
+
+}
+
+#endif /* !LIBDWARFPP_COMPRESS_HH */
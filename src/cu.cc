@@ -39,6 +39,13 @@ namespace Dwarf {
         , header_(header)
     {}
 
+    CompilationUnit::CompilationUnit(std::weak_ptr<const Debug> dbg,
+            std::shared_ptr<AnyDie> die,
+            const CUHeader& header)
+        : CompilationUnit(dbg, die, header.length, header.version,
+                          header.abbrev_offset, header.address_size, header.end())
+    {}
+
     bool CompilationUnit::operator==(const CompilationUnit &other) const {
         std::shared_ptr<const Debug> dbg = dbg_.lock();
         std::shared_ptr<const Debug> odbg = other.dbg_.lock();
@@ -60,96 +67,81 @@ namespace Dwarf {
         return die_->apply_visitor(v);
     }
 
-    // CUIterator
+    Dwarf::Addr CompilationUnit::base_address() const {
+        AttributeValue lo = get_die().get_value(DW_AT_low_pc);
+        return lo.kind() == AttributeValue::ADDRESS ? lo.as_address() : 0;
+    }
 
-    CUIterator::CUIterator(std::shared_ptr<const Debug>& dbg, std::shared_ptr<CompilationUnit>& value) throw (Exception)
-            : dbg_(dbg)
-            , next_(std::make_shared<std::unique_ptr<CUIterator>>(nullptr))
-            , value_(value)
-    {
-        end_ = !value;
+    DieRange CompilationUnit::dies() const {
+        if (const CompilationUnit* split = split_unit())
+            return split->dies();
+        return DieRange(&get_die(), die_.get(), false, true, die_);
+    }
+
+    const DieTable& CompilationUnit::die_table() const {
+        if (const CompilationUnit* split = split_unit())
+            return split->die_table();
+        if (!table_) {
+            std::shared_ptr<const Debug> dbg = dbg_.lock();
+            if (!dbg)
+                throw DebugClosedException();
+            table_ = std::make_shared<DieTable>(dbg, get_die().get_offset());
+        }
+        return *table_;
+    }
+
+    const LineTable& CompilationUnit::line_table() const {
+        if (!lines_) {
+            std::shared_ptr<const Debug> dbg = dbg_.lock();
+            if (!dbg)
+                throw DebugClosedException();
+            lines_ = std::make_shared<LineTable>(*dbg, get_die().get_handle(), version_stamp_);
+        }
+        return *lines_;
     }
 
-    CUIterator::CUIterator(const CUIterator& other)
-            : dbg_(other.dbg_)
-            , end_(other.end_)
-            , next_(other.next_)
-            , value_(other.value_)
+    // CUIterator
+
+    constexpr size_t CUIterator::npos;
+
+    CUIterator::CUIterator(std::shared_ptr<const Debug> dbg, size_t index)
+            : dbg_(dbg)
+            , index_(index)
     {}
 
     const CompilationUnit& CUIterator::operator*() const {
-        return *value_;
+        std::shared_ptr<const Debug> dbg = dbg_.lock();
+        if (!dbg)
+            throw DebugClosedException();
+        return dbg->cu(index_);
+    }
+
+    const CompilationUnit* CUIterator::operator->() const {
+        return &**this;
     }
 
     bool CUIterator::operator==(const CUIterator &other) const {
-        return (end_ && other.end_) || value_ == other.value_;
+        return index_ == other.index_;
     }
 
     bool CUIterator::operator!=(const CUIterator &other) const {
         return !(*this == other);
     }
 
-    CUIterator& CUIterator::operator=(const CUIterator& cu) {
-        next_  = std::move(cu.next_);
-        value_ = std::move(cu.value_);
-        end_   = cu.end_;
-        dbg_   = cu.dbg_;
-        return *this;
-    }
-
     CUIterator& CUIterator::operator++() {
-        if (!end_) {
-            if (!*next_) {
-                std::shared_ptr<const Debug> dbg = dbg_.lock();
-                if (!dbg)
-                    throw DebugClosedException();
-                *next_ = next(dbg);
-            }
-            *this = **next_;
+        if (index_ != npos) {
+            std::shared_ptr<const Debug> dbg = dbg_.lock();
+            if (!dbg)
+                throw DebugClosedException();
+            if (++index_ >= dbg->cu_count())
+                index_ = npos;
         }
         return *this;
     }
 
-    std::unique_ptr<CUIterator> CUIterator::next(std::shared_ptr<const Debug> dbg) {
-        std::shared_ptr<CompilationUnit> cu = next_cu(dbg);
-        return std::make_unique<CUIterator>(dbg, cu);
-    }
-
-    std::unique_ptr<CUIterator> CUIterator::end(std::shared_ptr<const Debug> dbg) {
-        std::shared_ptr<CompilationUnit> cu = nullptr;
-        return std::make_unique<CUIterator>(dbg, cu);
-    }
-
-    std::shared_ptr<CompilationUnit> CUIterator::next_cu(std::shared_ptr<const Debug> dbg) {
-        Error err;
-        Unsigned header_len, abbrev_offset, header;
-        Half version_stamp, address_size;
-
-        switch (dwarf::dwarf_next_cu_header(dbg->get_handle(),
-                &header_len,
-                &version_stamp,
-                &abbrev_offset,
-                &address_size,
-                &header,
-                &err))
-        {
-            case DW_DLV_NO_ENTRY:
-                return nullptr;
-            case DW_DLV_ERROR:
-                throw Exception(dbg, err);
-            default: break;
-        }
-
-        dwarf::Dwarf_Die die;
-        switch (dwarf::dwarf_siblingof(dbg->get_handle(), NULL, &die, &err)) {
-            case DW_DLV_NO_ENTRY:
-                return nullptr;
-            case DW_DLV_ERROR:
-                throw Exception(dbg, err);
-            default: break;
-        }
-        std::shared_ptr<AnyDie> d = make_die(Die::get_tag_id(dbg, die), dbg, die);
-
-        return std::make_shared<CompilationUnit>(dbg, d, header_len, version_stamp, abbrev_offset, address_size, header);
+    CUIterator CUIterator::operator++(int) {
+        CUIterator prev = *this;
+        ++*this;
+        return prev;
     }
-}
\ No newline at end of file
+}
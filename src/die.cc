@@ -1,18 +1,40 @@
 #include "libdwarf++/die.hh"
-#include <unordered_map>
+#include "libdwarf++/cu.hh"
+#include "reader.hh"
+#include "walk.hh"
 
 namespace Dwarf {
 
-    DieData::DieData(std::weak_ptr<const Debug> dbg, dwarf::Dwarf_Die& die)
+    DieData::DieData(std::weak_ptr<const Debug> dbg, dwarf::Dwarf_Die& die, Dwarf::Half tag)
         : dbg_(dbg)
         , die(die)
         , sibling()
         , child()
         , name(nullptr)
         , offset(0)
+        , tag(tag)
+        , locations_attr(0)
     {}
 
     DieData::~DieData() {
+        // Unlink the sibling and child chains here rather than through the
+        // shared_ptr destructors, which would recurse once per DIE.
+        std::vector<std::shared_ptr<AnyDie>> pending;
+        if (sibling) pending.push_back(std::move(sibling));
+        if (child)   pending.push_back(std::move(child));
+        while (!pending.empty()) {
+            std::shared_ptr<AnyDie> any = std::move(pending.back());
+            pending.pop_back();
+            if (any.use_count() != 1)
+                continue;
+            Die::visitor_to_die visitor;
+            std::shared_ptr<DieData>& data = any->apply_visitor(visitor).data_;
+            if (!data || data.use_count() != 1)
+                continue;
+            if (data->sibling) pending.push_back(std::move(data->sibling));
+            if (data->child)   pending.push_back(std::move(data->child));
+        }
+
         std::shared_ptr<const Debug> dbg = dbg_.lock();
         if (dbg) {
             if (die) dbg->dealloc(die);
@@ -21,8 +43,12 @@ namespace Dwarf {
     }
 
     Die::Die(std::weak_ptr<const Debug> dbg, dwarf::Dwarf_Die& die)
+        : Die(dbg, die, get_tag_id(dbg, die))
+    {}
+
+    Die::Die(std::weak_ptr<const Debug> dbg, dwarf::Dwarf_Die& die, Dwarf::Half tag)
         : dbg_(dbg)
-        , data_(new DieData(dbg, die))
+        , data_(new DieData(dbg, die, tag))
     {}
 
     Die::Die() {}
@@ -30,15 +56,16 @@ namespace Dwarf {
     Die::~Die() {}
 
     void Die::traverse(std::function<TraversalResult(Die&, void*)> func, void* data) {
-        switch (func(*this, data)) {
-            case Die::TraversalResult::SKIP:  break;
-            case Die::TraversalResult::BREAK: return;
+        DieIterator end;
+        for (DieIterator it(this, nullptr, true, true); it != end; ++it) {
+            switch (func(*it, data)) {
+                case Die::TraversalResult::SKIP:  it.skip_children(); break;
+                case Die::TraversalResult::BREAK: return;
 
-            default:
-            case Die::TraversalResult::TRAVERSE:
-                child().traverse(func, data);
+                default:
+                case Die::TraversalResult::TRAVERSE: break;
+            }
         }
-        sibling().traverse(func, data);
     }
 
     void Die::traverse_headless(std::function<TraversalResult(Die&, void*)> func, void* data) {
@@ -57,29 +84,57 @@ namespace Dwarf {
         return data_->child->apply_visitor(visitor);
     }
 
+    DieRange Die::children() {
+        init_child();
+        if (data_->child->type() == typeid(EmptyDie))
+            return DieRange(nullptr, nullptr, true, false);
+        Die::visitor_to_die visitor;
+        return DieRange(&data_->child->apply_visitor(visitor), data_->child.get(), true, false);
+    }
+
     void Die::init_sibling() {
+        if (!data_->sibling)
+            data_->sibling = load_sibling(data_->child && data_->child->type() == typeid(EmptyDie));
+    }
+
+    void Die::init_child() {
+        if (!data_->child)
+            data_->child = load_child();
+    }
+
+    std::shared_ptr<AnyDie> Die::load_sibling(bool leaf) const {
         if (data_->sibling)
-            return;
+            return data_->sibling;
 
         std::shared_ptr<const Debug> dbg = dbg_.lock();
         if (!dbg)
             throw DebugClosedException();
         Error err;
         dwarf::Dwarf_Die sibling = nullptr;
+
+        // leaves are cheap for libdwarf; past a subtree, jump over it
+        Dwarf::Off next;
+        if (!leaf && dbg->next_sibling_offset(get_offset(), next)) {
+            if (!next)
+                return std::make_shared<AnyDie>(EmptyDie());
+            if (dwarf::dwarf_offdie(dbg->get_handle(), next, &sibling, &err) == DW_DLV_ERROR)
+                throw Exception(dbg, err);
+            return Dwarf::make_die(get_tag_id(dbg_, sibling), dbg_, sibling);
+        }
+
         switch (dwarf::dwarf_siblingof(dbg->get_handle(), data_->die, &sibling, &err)) {
             case DW_DLV_NO_ENTRY:
-                data_->sibling = std::make_shared<AnyDie>(EmptyDie());
-                return;
+                return std::make_shared<AnyDie>(EmptyDie());
             case DW_DLV_ERROR:
                 throw Exception(dbg, err);
             default: break;
         }
-        data_->sibling = Dwarf::make_die(get_tag_id(dbg_, sibling), dbg_, sibling);
+        return Dwarf::make_die(get_tag_id(dbg_, sibling), dbg_, sibling);
     }
 
-    void Die::init_child() {
+    std::shared_ptr<AnyDie> Die::load_child() const {
         if (data_->child)
-            return;
+            return data_->child;
 
         std::shared_ptr<const Debug> dbg = dbg_.lock();
         if (!dbg)
@@ -88,24 +143,55 @@ namespace Dwarf {
         dwarf::Dwarf_Die child;
         switch (dwarf::dwarf_child(data_->die, &child, &err)) {
             case DW_DLV_NO_ENTRY:
-                data_->child = std::make_shared<AnyDie>(EmptyDie());
-                return;
+                return std::make_shared<AnyDie>(EmptyDie());
             case DW_DLV_ERROR:
                 throw Exception(dbg, err);
             default: break;
         }
-        data_->child = Dwarf::make_die(get_tag_id(dbg_, child), dbg_, child);
+        return Dwarf::make_die(get_tag_id(dbg_, child), dbg_, child);
     }
 
-    const Tag Die::get_tag() const throw(Exception) {
-        Error err;
-        Half tag;
-        switch (dwarf::dwarf_tag(data_->die, &tag, &err)) {
-            case DW_DLV_ERROR:
-                throw Exception(dbg_, err);
-            default: break;
+    void Die::walk(Die& start, WalkFunction func, void* context) {
+        std::shared_ptr<const Debug> dbg = start.dbg_.lock();
+        if (!dbg)
+            throw DebugClosedException();
+
+        // each Die owns its raw DIE, so a handle the visitor keeps stays
+        // valid; the walker itself only holds on to the open ancestors
+        std::vector<Die> parents;
+        Die cur = start;
+        for (;;) {
+            TraversalResult res = func(context, cur);
+            if (res == TraversalResult::BREAK)
+                return;
+
+            dwarf::Dwarf_Die next = res == TraversalResult::SKIP
+                    ? nullptr : raw_child(*dbg, cur.data_->die);
+            if (next) {
+                parents.push_back(std::move(cur));
+            } else {
+                next = raw_sibling(*dbg, cur.data_->die, res != TraversalResult::SKIP);
+                while (!next && !parents.empty()) {
+                    next = raw_sibling(*dbg, parents.back().data_->die);
+                    parents.pop_back();
+                }
+                if (!next)
+                    return;
+            }
+
+            Dwarf::Half tag;
+            try {
+                tag = static_cast<Dwarf::Half>(get_tag_id(dbg, next));
+            } catch (...) {
+                dbg->dealloc(next);
+                throw;
+            }
+            cur = Die(dbg, next, tag);
         }
-        return Tag(tag);
+    }
+
+    const Tag Die::get_tag() const throw(Exception) {
+        return Tag(data_->tag);
     }
 
     const char* Die::get_name() const throw(Exception) {
@@ -149,6 +235,145 @@ namespace Dwarf {
         return std::make_unique<Attribute>(dbg_, result);
     }
 
+    DieIterator::DieIterator()
+        : cur_(nullptr)
+        , any_(nullptr)
+        , siblings_(false)
+        , descend_(false)
+        , skip_(false)
+    {}
+
+    DieIterator::DieIterator(Die* start, AnyDie* start_any, bool siblings, bool descend)
+        : cur_(start)
+        , any_(start_any)
+        , siblings_(siblings)
+        , descend_(descend)
+        , skip_(false)
+    {}
+
+    void DieIterator::set(std::shared_ptr<AnyDie> die) {
+        Die::visitor_to_die visitor;
+        any_ = die.get();
+        cur_ = &die->apply_visitor(visitor);
+        owner_ = std::move(die);
+    }
+
+    DieIterator& DieIterator::operator++() {
+        if (!cur_)
+            return *this;
+
+        bool skip = skip_ || !descend_;
+        skip_ = false;
+
+        bool leaf = false;
+        if (!skip) {
+            std::shared_ptr<AnyDie> child = cur_->load_child();
+            if (child->type() != typeid(EmptyDie)) {
+                stack_.push_back(Frame { cur_, std::move(owner_) });
+                set(std::move(child));
+                return *this;
+            }
+            leaf = true;
+        }
+
+        for (;;) {
+            if (stack_.empty() && !siblings_)
+                break;
+
+            std::shared_ptr<AnyDie> sibling = cur_->load_sibling(leaf);
+            if (sibling->type() != typeid(EmptyDie)) {
+                set(std::move(sibling));
+                return *this;
+            }
+
+            if (stack_.empty())
+                break;
+            // an ancestor we climb back to had children by construction
+            leaf = false;
+            cur_ = stack_.back().die;
+            owner_ = std::move(stack_.back().owner);
+            stack_.pop_back();
+        }
+
+        cur_ = nullptr;
+        any_ = nullptr;
+        owner_.reset();
+        return *this;
+    }
+
+    const AttributeList& Die::attributes() const {
+        if (!data_->attributes.loaded()) {
+            std::shared_ptr<const Debug> dbg = dbg_.lock();
+            if (!dbg)
+                throw DebugClosedException();
+            data_->attributes.load(*dbg, data_->die);
+        }
+        return data_->attributes;
+    }
+
+    std::shared_ptr<AnyDie> Die::get_reference(Dwarf::Half attr) const {
+        const AttributeEntry* e = attributes().get(attr);
+        if (!e)
+            return nullptr;
+        std::shared_ptr<const Debug> dbg = dbg_.lock();
+        if (!dbg)
+            throw DebugClosedException();
+        switch (e->value.kind()) {
+            case AttributeValue::REFERENCE: return dbg->offdie(e->value.as_reference());
+            case AttributeValue::SIGNATURE: return dbg->signature_die(e->value.as_signature());
+            default: throw std::runtime_error("Unexpected non-reference attribute");
+        }
+    }
+
+    /* Offset held by attribute attr of a unit DIE, or fallback. */
+    static Dwarf::Off unit_offset(const Die& die, Dwarf::Half attr, Dwarf::Off fallback) {
+        AttributeValue value = die.get_value(attr);
+        switch (value.kind()) {
+            case AttributeValue::SECTION_OFFSET: return value.as_section_offset();
+            case AttributeValue::UNSIGNED:       return value.as_unsigned();
+            default:                             return fallback;
+        }
+    }
+
+    std::shared_ptr<const LocationList> Die::get_location_list(Dwarf::Half attr) const {
+        if (data_->locations && data_->locations_attr == attr)
+            return data_->locations;
+
+        std::unique_ptr<const Attribute> a = get_attribute(attr);
+        if (!a)
+            return nullptr;
+
+        std::shared_ptr<const Debug> dbg = dbg_.lock();
+        if (!dbg)
+            throw DebugClosedException();
+
+        // location list entries are relative to the base address of the
+        // unit, and DWARF 5 lists are indexed through tables it points to
+        LocationList::Unit unit;
+        const size_t index = dbg->cu_index_for_offset(get_offset());
+        if (index < dbg->cu_count()) {
+            const CUHeader& header = dbg->cu_header(index);
+            const CompilationUnit& cu = dbg->cu(index);
+            unit.base = cu.base_address();
+            unit.version = header.version;
+            unit.address_size = header.address_size;
+            if (unit.version >= 5) {
+                Span<const Dwarf::Small> info = dbg->raw_section(".debug_info");
+                if (info.empty())
+                    info = dbg->raw_section(".debug_info.dwo");
+                unit.offset_size = unit_offset_size(info, header.offset);
+                unit.addr_base = unit_offset(cu.get_die(), DW_AT_addr_base, 0);
+                // without the attribute, indices refer to the first table
+                unit.loclists_base = unit_offset(cu.get_die(), DW_AT_loclists_base,
+                                                 unit.offset_size == 8 ? 20 : 12);
+            }
+        }
+
+        data_->locations = std::make_shared<const LocationList>(*dbg, a->get_handle(), unit);
+        data_->locations_attr = attr;
+        return data_->locations;
+    }
+
     Attribute::Attribute(std::weak_ptr<const Debug> dbg, dwarf::Dwarf_Attribute attr)
         : dbg_(dbg)
         , attr_(attr)
@@ -169,107 +394,32 @@ namespace Dwarf {
         }
     }
 
-    using tag_to_die_map = typename std::unordered_map<unsigned int, std::shared_ptr<AnyDie>(*)(std::weak_ptr<const Debug>&, dwarf::Dwarf_Die)>;
+    namespace {
 
-    template <unsigned int... Tags>
-    struct populate_map;
+        struct FactoryThunk {
+            using Fn = std::shared_ptr<AnyDie> (*)(std::weak_ptr<const Debug>&, dwarf::Dwarf_Die, unsigned);
 
-    template <unsigned int FirstTag, unsigned int... Tags>
-    struct populate_map<FirstTag, Tags...> {
-        static void run(tag_to_die_map & map) {
-            populate_map<FirstTag>::run(map);
-            populate_map<Tags...>::run(map);
-        }
-    };
+            template <unsigned Tag>
+            struct Known {
+                static std::shared_ptr<AnyDie> call(std::weak_ptr<const Debug>& dbg, dwarf::Dwarf_Die die, unsigned) {
+                    return Die::make_die<Tag>(dbg, die);
+                }
+            };
 
-    template <unsigned int Tag>
-    struct populate_map<Tag> {
-        static void run(tag_to_die_map & map) {
-            map.insert(std::make_pair(Tag, Die::make_die<Tag>));
-        }
-    };
+            struct Unknown {
+                static std::shared_ptr<AnyDie> call(std::weak_ptr<const Debug>& dbg, dwarf::Dwarf_Die die, unsigned tag) {
+                    return std::make_shared<AnyDie>(Die(dbg, die, static_cast<Dwarf::Half>(tag)));
+                }
+            };
+        };
 
-    template <unsigned int... Tags>
-    static tag_to_die_map create_map() {
-        tag_to_die_map map;
-        populate_map<Tags...>::run(map);
-        return map;
     }
 
-    tag_to_die_map tag_to_die = create_map<
-            DW_TAG_array_type,
-            DW_TAG_class_type,
-            DW_TAG_entry_point,
-            DW_TAG_enumeration_type,
-            DW_TAG_formal_parameter,
-            DW_TAG_imported_declaration,
-            DW_TAG_label,
-            DW_TAG_lexical_block,
-            DW_TAG_member,
-            DW_TAG_pointer_type,
-            DW_TAG_reference_type,
-            DW_TAG_compile_unit,
-            DW_TAG_string_type,
-            DW_TAG_structure_type,
-            DW_TAG_subroutine_type,
-            DW_TAG_typedef,
-            DW_TAG_union_type,
-            DW_TAG_unspecified_parameters,
-            DW_TAG_variant,
-            DW_TAG_common_block,
-            DW_TAG_common_inclusion,
-            DW_TAG_inheritance,
-            DW_TAG_inlined_subroutine,
-            DW_TAG_module,
-            DW_TAG_ptr_to_member_type,
-            DW_TAG_set_type,
-            DW_TAG_subrange_type,
-            DW_TAG_with_stmt,
-            DW_TAG_access_declaration,
-            DW_TAG_base_type,
-            DW_TAG_catch_block,
-            DW_TAG_const_type,
-            DW_TAG_constant,
-            DW_TAG_enumerator,
-            DW_TAG_file_type,
-            DW_TAG_friend,
-            DW_TAG_namelist,
-            DW_TAG_namelist_item,
-            DW_TAG_packed_type,
-            DW_TAG_subprogram,
-            DW_TAG_template_type_parameter,
-            DW_TAG_template_value_parameter,
-            DW_TAG_thrown_type,
-            DW_TAG_try_block,
-            DW_TAG_variant_part,
-            DW_TAG_variable,
-            DW_TAG_volatile_type,
-            DW_TAG_dwarf_procedure,
-            DW_TAG_restrict_type,
-            DW_TAG_interface_type,
-            DW_TAG_namespace,
-            DW_TAG_imported_module,
-            DW_TAG_unspecified_type,
-            DW_TAG_partial_unit,
-            DW_TAG_imported_unit,
-            DW_TAG_mutable_type,
-            DW_TAG_condition,
-            DW_TAG_shared_type,
-            DW_TAG_type_unit,
-            DW_TAG_rvalue_reference_type,
-            DW_TAG_template_alias,
-            DW_TAG_coarray_type,
-            DW_TAG_generic_subrange,
-            DW_TAG_dynamic_type,
-            DW_TAG_atomic_type,
-            DW_TAG_call_site,
-            DW_TAG_call_site_parameter
-        >();
+    // every known tag plus Die and EmptyDie
+    static_assert(boost::mpl::size<AnyDie::types>::value == KnownTags::count + 2,
+                  "KnownTags and AnyDie are out of sync");
 
     std::shared_ptr<AnyDie> make_die(unsigned int tag, std::weak_ptr<const Debug> dbg, dwarf::Dwarf_Die &die) {
-        auto it = tag_to_die.find(tag);
-        if (it == tag_to_die.end())
-            return std::make_shared<AnyDie>(Die(dbg, die));
-        return (it->second)(dbg, die);
+        return TagTable<FactoryThunk>::get(tag)(dbg, die, tag);
     }
 }
@@ -0,0 +1,117 @@
+/*
+ *  This file is part of libdwarf++.
+ *
+ *  Copyright © 2015 Frankin "Snaipe" Mathieu <http://snaipe.me>
+ *
+ *  libdwarf++ is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libdwarf++ is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libdwarf++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LIBDWARFPP_DIECACHE_HH
+# define LIBDWARFPP_DIECACHE_HH
+
+# include <memory>
+# include <unordered_map>
+# include <vector>
+# include "libdwarf++/die.hh"
+
+namespace Dwarf {
+
+    /*
+     * Offset-keyed cache of materialized DIEs with CLOCK eviction: a hit
+     * only sets a reference bit, and a miss on a full cache sweeps the
+     * hand over the slots, giving referenced ones a second chance.
+     *
+     * The hand also drops the sibling and child links of the DIEs it
+     * passes that only the cache still holds, so that the entry count
+     * bounds the memory the cache keeps alive, not only the slots.
+     */
+    class DieCache {
+    public:
+        explicit DieCache(size_t capacity) : capacity_(capacity), hand_(0) {}
+
+        size_t capacity() const {
+            return capacity_;
+        }
+
+        void set_capacity(size_t capacity) {
+            capacity_ = capacity;
+            if (slots_.size() > capacity)
+                clear();
+        }
+
+        void clear() {
+            slots_.clear();
+            index_.clear();
+            hand_ = 0;
+        }
+
+        std::shared_ptr<AnyDie> get(Dwarf::Off offset) {
+            auto it = index_.find(offset);
+            if (it == index_.end())
+                return nullptr;
+            Slot& slot = slots_[it->second];
+            slot.referenced = true;
+            return slot.die;
+        }
+
+        void put(Dwarf::Off offset, const std::shared_ptr<AnyDie>& die) {
+            if (!capacity_ || !die)
+                return;
+
+            if (slots_.size() < capacity_) {
+                index_.emplace(offset, slots_.size());
+                slots_.push_back({offset, die, false});
+                return;
+            }
+
+            while (slots_[hand_].referenced) {
+                slots_[hand_].referenced = false;
+                release_links(slots_[hand_]);
+                hand_ = (hand_ + 1) % slots_.size();
+            }
+
+            Slot& victim = slots_[hand_];
+            index_.erase(victim.offset);
+            victim = {offset, die, false};
+            index_.emplace(offset, hand_);
+            hand_ = (hand_ + 1) % slots_.size();
+        }
+
+    private:
+        struct Slot {
+            Dwarf::Off offset;
+            std::shared_ptr<AnyDie> die;
+            bool referenced;
+        };
+
+        static void release_links(Slot& slot) {
+            if (slot.die.use_count() != 1)
+                return;
+            Die::visitor_to_die visitor;
+            std::shared_ptr<DieData>& data = slot.die->apply_visitor(visitor).data_;
+            if (!data || data.use_count() != 1)
+                return;
+            data->sibling.reset();
+            data->child.reset();
+        }
+
+        size_t capacity_;
+        size_t hand_;
+        std::vector<Slot> slots_;
+        std::unordered_map<Dwarf::Off, size_t> index_;
+    };
+
+}
+
+#endif /* !LIBDWARFPP_DIECACHE_HH */
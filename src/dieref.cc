@@ -0,0 +1,136 @@
+/*
+ *  This file is part of libdwarf++.
+ *
+ *  Copyright © 2015 Frankin "Snaipe" Mathieu <http://snaipe.me>
+ *
+ *  libdwarf++ is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libdwarf++ is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libdwarf++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "libdwarf++/dieref.hh"
+#include "libdwarf++/cu.hh"
+#include "walk.hh"
+
+namespace Dwarf {
+
+    DieContext::DieContext(const Debug& dbg)
+        : dbg_(dbg)
+        , unit_dbg_(nullptr)
+        , unit_(nullptr)
+        , table_(nullptr)
+        , cu_(static_cast<uint32_t>(-1))
+        , attrs_ref_ { static_cast<uint32_t>(-1), DieTable::npos }
+    {}
+
+    void DieContext::load(uint32_t cu) {
+        const CompilationUnit& unit = dbg_.cu(cu).unit();
+        table_ = &unit.die_table();
+        // split units are owned by the Debug of the skeleton, which keeps
+        // them alive as long as dbg_
+        unit_dbg_ = unit.get_die().get_debug().get();
+        unit_ = &unit;
+        cu_ = cu;
+    }
+
+    DieRef DieContext::unit(size_t cu) {
+        const uint32_t index = static_cast<uint32_t>(cu);
+        return { index, table(index).size() ? 0 : DieTable::npos };
+    }
+
+    DieRef DieContext::at(Dwarf::Off offset) {
+        // the table of a split unit holds .dwo offsets, which overlap those
+        // of dbg_: only the table of a plain unit can answer directly
+        if (cu_ != static_cast<uint32_t>(-1) && unit_dbg_ == &dbg_) {
+            DieTable::Index row = table_->find(offset);
+            if (row != DieTable::npos)
+                return { cu_, row };
+        }
+
+        size_t cu = dbg_.cu_index_for_offset(offset);
+        if (cu == dbg_.cu_count())
+            return { 0, DieTable::npos };
+        const uint32_t index = static_cast<uint32_t>(cu);
+
+        // all a skeleton holds in dbg_ is its unit DIE, which stands for
+        // the root of the split unit
+        if (dbg_.cu(index).split_unit()) {
+            if (offset != dbg_.cu_header(index).die_offset)
+                return { index, DieTable::npos };
+            return unit(index);
+        }
+        return { index, table(index).find(offset) };
+    }
+
+    DieRef DieContext::split_at(Dwarf::Off offset) {
+        const Debug& split = *unit_dbg_;
+        const size_t target = split.cu_index_for_offset(offset);
+        if (target == split.cu_count() || &split.cu(target) == unit_)
+            return { 0, DieTable::npos };
+
+        // another unit of the package: find the skeleton it belongs to
+        const CompilationUnit* unit = &split.cu(target);
+        for (size_t i = 0; i < dbg_.cu_count(); ++i) {
+            if (&dbg_.cu(i).unit() == unit) {
+                const uint32_t index = static_cast<uint32_t>(i);
+                return { index, table(index).find(offset) };
+            }
+        }
+        return { 0, DieTable::npos };
+    }
+
+    const AttributeList& DieContext::attributes(DieRef r) {
+        if (r == attrs_ref_)
+            return attrs_;
+
+        const Dwarf::Off off = offset(r);
+        attrs_ = AttributeList();
+        attrs_ref_ = { static_cast<uint32_t>(-1), DieTable::npos };
+        dwarf::Dwarf_Die die = raw_offdie(*unit_dbg_, off);
+        if (!die)
+            return attrs_;
+        try {
+            attrs_.load(*unit_dbg_, die);
+        } catch (...) {
+            unit_dbg_->dealloc(die);
+            throw;
+        }
+        unit_dbg_->dealloc(die);
+        attrs_ref_ = r;
+        return attrs_;
+    }
+
+    AttributeValue DieContext::value(DieRef r, Dwarf::Half attr) {
+        const AttributeEntry* e = attributes(r).get(attr);
+        return e ? e->value : AttributeValue();
+    }
+
+    DieRef DieContext::reference(DieRef r, Dwarf::Half attr) {
+        AttributeValue v = value(r, attr);
+        if (v.kind() != AttributeValue::REFERENCE)
+            return { r.cu, DieTable::npos };
+
+        // references almost always stay within the unit
+        DieTable::Index row = table(r.cu).find(v.as_reference());
+        if (row != DieTable::npos)
+            return { r.cu, row };
+        // those of a split unit are offsets in its .dwo or .dwp
+        if (unit_dbg_ != &dbg_)
+            return split_at(v.as_reference());
+        return at(v.as_reference());
+    }
+
+    std::shared_ptr<AnyDie> DieContext::materialize(DieRef r) {
+        return table(r.cu).materialize(r.row);
+    }
+
+}
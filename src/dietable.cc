@@ -0,0 +1,94 @@
+/*
+ *  This file is part of libdwarf++.
+ *
+ *  Copyright © 2015 Frankin "Snaipe" Mathieu <http://snaipe.me>
+ *
+ *  libdwarf++ is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libdwarf++ is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libdwarf++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <algorithm>
+#include "libdwarf++/dietable.hh"
+#include "walk.hh"
+
+namespace Dwarf {
+
+    constexpr DieTable::Index DieTable::npos;
+
+    DieTable::DieTable(std::shared_ptr<const Debug> dbg, Dwarf::Off cu_die_offset)
+        : dbg_(dbg)
+    {
+        dwarf::Dwarf_Die root = raw_offdie(*dbg, cu_die_offset);
+        if (!root)
+            return;
+
+        // last row seen at each depth, used to link up siblings
+        std::vector<Index> open;
+
+        auto record = [&](dwarf::Dwarf_Die die, unsigned depth) {
+            Error err;
+            Dwarf::Half tag;
+            Dwarf::Off offset;
+            if (dwarf::dwarf_tag(die, &tag, &err) == DW_DLV_ERROR
+                    || dwarf::dwarf_dieoffset(die, &offset, &err) == DW_DLV_ERROR)
+                throw Exception(dbg, err);
+
+            Index i = size();
+            if (open.size() > depth) {
+                siblings_[open[depth]] = i;
+                open.resize(depth);
+            }
+
+            offsets_.push_back(offset);
+            tags_.push_back(tag);
+            depths_.push_back(depth);
+            parents_.push_back(depth > 0 ? open[depth - 1] : npos);
+            siblings_.push_back(npos);
+            abbrevs_.push_back(dwarf::dwarf_die_abbrev_code(die));
+
+            open.push_back(i);
+            return Die::TraversalResult::TRAVERSE;
+        };
+
+        try {
+            walk_dies(*dbg, root, record);
+        } catch (...) {
+            dbg->dealloc(root);
+            throw;
+        }
+        dbg->dealloc(root);
+    }
+
+    DieTable::Index DieTable::subtree_end(Index i) const {
+        for (Index p = i; p != npos; p = parents_[p]) {
+            if (siblings_[p] != npos)
+                return siblings_[p];
+        }
+        return size();
+    }
+
+    DieTable::Index DieTable::find(Dwarf::Off offset) const {
+        auto it = std::lower_bound(offsets_.begin(), offsets_.end(), offset);
+        if (it == offsets_.end() || *it != offset)
+            return npos;
+        return static_cast<Index>(it - offsets_.begin());
+    }
+
+    std::shared_ptr<AnyDie> DieTable::materialize(Index i) const {
+        std::shared_ptr<const Debug> dbg = dbg_.lock();
+        if (!dbg)
+            throw DebugClosedException();
+        return dbg->offdie(offsets_[i]);
+    }
+
+}
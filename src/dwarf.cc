@@ -17,8 +17,19 @@
  *  along with libdwarf++.  If not, see <http://www.gnu.org/licenses/>.
  *
  */
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "libdwarf++/dwarf.hh"
 #include "libdwarf++/cu.hh"
+#include "libdwarf++/addrindex.hh"
+#include "libdwarf++/nameindex.hh"
+#include "parallel.hh"
+#include "diecache.hh"
+#include "image.hh"
 
 namespace posix {
 extern "C" {
@@ -44,6 +55,7 @@ namespace Dwarf {
     Debug::Debug(int fd, Dwarf::Unsigned access, Dwarf::Handler handler, Dwarf::Ptr errarg)
             throw (InitException, NoDebugInformationException)
         : fd_(fd)
+        , die_cache_(new DieCache(4096))
     {
 
         dwarf::Dwarf_Error err;
@@ -59,31 +71,57 @@ namespace Dwarf {
 
     }
 
+    Debug::Debug(std::shared_ptr<ObjectImage> image)
+            throw (InitException, NoDebugInformationException)
+        : fd_(-1)
+        , image_(std::move(image))
+        , die_cache_(new DieCache(4096))
+    {
+
+        dwarf::Dwarf_Error err;
+        switch (dwarf::dwarf_object_init(image_->interface(), nullptr, nullptr, &handle_, &err)) {
+            default:
+            case DW_DLV_ERROR:
+                throw InitException(err);
+            case DW_DLV_NO_ENTRY:
+                throw NoDebugInformationException();
+            case DW_DLV_OK:
+                break;
+        }
+
+    }
+
+    static int finish_handle(dwarf::Dwarf_Debug handle, bool object, Error* err) {
+        return object ? dwarf::dwarf_object_finish(handle, err) : dwarf::dwarf_finish(handle, err);
+    }
+
     Debug::~Debug() {
         Error err;
-        dwarf::dwarf_finish(handle_, &err);
+        finish_handle(handle_, image_ != nullptr, &err);
+        if (fd_ != -1)
+            ::close(fd_);
     }
 
     void Debug::close() const throw (Exception) {
         Error err;
-        if (dwarf::dwarf_finish(handle_, &err) != DW_DLV_OK)
+        if (finish_handle(handle_, image_ != nullptr, &err) != DW_DLV_OK)
             throw Exception(shared_from_this(), err);
     }
 
-    CUIterator& Debug::begin() const {
-        return *begin_;
+    CUIterator Debug::begin() const {
+        return CUIterator(shared_from_this(), cu_count() ? 0 : CUIterator::npos);
     }
 
-    CUIterator& Debug::end() const {
-        return *end_;
+    CUIterator Debug::end() const {
+        return CUIterator(shared_from_this(), CUIterator::npos);
     }
 
-    CUIterator& Debug::cbegin() const {
-        return *begin_;
+    CUIterator Debug::cbegin() const {
+        return begin();
     }
 
-    CUIterator& Debug::cend() const {
-        return *end_;
+    CUIterator Debug::cend() const {
+        return end();
     }
 
     Debug::operator std::shared_ptr<const Debug>() const {
@@ -94,9 +132,19 @@ namespace Dwarf {
         int fd = posix::open(path, O_RDONLY);
         if (fd == -1)
             return nullptr;
-        std::shared_ptr<Debug> ref(new Debug(fd));
-        ref->begin_ = CUIterator::next(ref);
-        ref->end_   = CUIterator::end(ref);
+        return make(new Debug(fd), path);
+    }
+
+    std::shared_ptr<const Debug> Debug::make(Debug* dbg, const std::string& path) {
+        std::shared_ptr<Debug> ref(dbg);
+        ref->path_  = path;
+
+        struct stat st;
+        if ((ref->fd_ != -1 && ::fstat(ref->fd_, &st) == 0)
+                || (!path.empty() && ::stat(path.c_str(), &st) == 0)) {
+            ref->dev_ = static_cast<uint64_t>(st.st_dev);
+            ref->ino_ = static_cast<uint64_t>(st.st_ino);
+        }
         return ref;
     }
 
@@ -104,7 +152,148 @@ namespace Dwarf {
         return open("/proc/self/exe");
     }
 
+    std::shared_ptr<const Debug> Debug::reopen() const {
+        if (image_)
+            return make(new Debug(image_), path_);
+
+        // handles opened with libelf copy every section they read: map
+        // the file once instead, and have every reopened handle share it
+        if (!reopen_image_)
+            reopen_image_ = ObjectImage::map(path_.c_str(), MapOptions());
+        if (reopen_image_)
+            return make(new Debug(reopen_image_), path_);
+        return open(path_.c_str());
+    }
+
+    void Debug::parallel_for_each_cu(const CUCallback& func, unsigned threads) const {
+        parallel_units(*this, threads,
+            [&func](const Debug&, const CompilationUnit& cu, size_t, unsigned) {
+                func(cu);
+            });
+    }
+
+    void Debug::load_cu_headers() const {
+        if (cus_loaded_)
+            return;
+
+        // nothing else walks the unit chain of the handle, so its cursor
+        // is free for a single scan: it rewinds once the scan is over
+        dwarf::Dwarf_Debug handle = handle_;
+        Error err;
+
+        // a scan that failed part way left the cursor inside the chain:
+        // run it to the end, which rewinds it, before starting over
+        auto drain = [&]() -> int {
+            for (;;) {
+                Unsigned length, abbrev_offset, next;
+                Half version, address_size;
+                int res = dwarf::dwarf_next_cu_header(handle, &length, &version,
+                        &abbrev_offset, &address_size, &next, &err);
+                if (res == DW_DLV_NO_ENTRY) {
+                    cu_cursor_dirty_ = false;
+                    return DW_DLV_OK;
+                }
+                if (res == DW_DLV_ERROR)
+                    return res;
+            }
+        };
+        if (cu_cursor_dirty_ && drain() == DW_DLV_ERROR)
+            throw Exception(shared_from_this(), err);
+
+        std::vector<CUHeader> headers;
+        Dwarf::Off offset = 0;
+        cu_cursor_dirty_ = true;
+        for (;;) {
+            CUHeader h;
+            Unsigned next;
+            int res = dwarf::dwarf_next_cu_header(handle, &h.length, &h.version,
+                    &h.abbrev_offset, &h.address_size, &next, &err);
+            if (res == DW_DLV_NO_ENTRY)
+                break;
+
+            dwarf::Dwarf_Die die = nullptr;
+            if (res == DW_DLV_OK)
+                res = dwarf::dwarf_siblingof(handle, nullptr, &die, &err);
+            if (res == DW_DLV_OK) {
+                res = dwarf::dwarf_dieoffset(die, &h.die_offset, &err);
+                dwarf::dwarf_dealloc(handle, die, DW_DLA_DIE);
+            }
+            if (res == DW_DLV_ERROR) {
+                Error failure = err;
+                if (drain() == DW_DLV_ERROR)
+                    dealloc(err);
+                throw Exception(shared_from_this(), failure);
+            }
+
+            h.offset = offset;
+            h.length = next - offset;
+            offset = next;
+            if (res == DW_DLV_OK)
+                headers.push_back(h);
+        }
+        cu_cursor_dirty_ = false;
+
+        cu_headers_ = std::move(headers);
+        cus_.assign(cu_headers_.size(), nullptr);
+        cus_loaded_ = true;
+    }
+
+    size_t Debug::cu_count() const {
+        load_cu_headers();
+        return cu_headers_.size();
+    }
+
+    const CUHeader& Debug::cu_header(size_t index) const {
+        load_cu_headers();
+        return cu_headers_.at(index);
+    }
+
+    const CompilationUnit& Debug::cu(size_t index) const {
+        const CUHeader& h = cu_header(index);
+        if (!cus_[index])
+            cus_[index] = std::make_shared<CompilationUnit>(shared_from_this(), offdie(h.die_offset), h);
+        return *cus_[index];
+    }
+
+    size_t Debug::cu_index_for_offset(Dwarf::Off offset) const {
+        load_cu_headers();
+        auto it = std::upper_bound(cu_headers_.begin(), cu_headers_.end(), offset,
+                [](Dwarf::Off off, const CUHeader& h) { return off < h.offset; });
+        if (it == cu_headers_.begin())
+            return cu_headers_.size();
+        --it;
+        if (offset >= it->end())
+            return cu_headers_.size();
+        return static_cast<size_t>(it - cu_headers_.begin());
+    }
+
+    const CompilationUnit* Debug::cu_for_offset(Dwarf::Off offset) const {
+        size_t index = cu_index_for_offset(offset);
+        if (index == cu_count())
+            return nullptr;
+        return &cu(index);
+    }
+
+    const AddressIndex& Debug::address_index() const {
+        if (!address_index_) {
+            address_index_ = std::make_shared<AddressIndex>(*this);
+            save_index();
+        }
+        return *address_index_;
+    }
+
+    const NameIndex& Debug::name_index() const {
+        if (!name_index_) {
+            name_index_ = std::make_shared<NameIndex>(*this);
+            save_index();
+        }
+        return *name_index_;
+    }
+
     std::shared_ptr<AnyDie> Debug::offdie(Dwarf::Off offset) const {
+        if (std::shared_ptr<AnyDie> cached = die_cache_->get(offset))
+            return cached;
+
         dwarf::Dwarf_Die die;
         Dwarf::Error err;
         switch (dwarf::dwarf_offdie(handle_, offset, &die, &err)) {
@@ -113,7 +302,49 @@ namespace Dwarf {
             default: break;
         }
         std::shared_ptr<const Debug> dbg = shared_from_this();
+        std::shared_ptr<AnyDie> result = make_die(Die::get_tag_id(dbg, die), dbg, die);
+        die_cache_->put(offset, result);
+        return result;
+    }
+
+    std::shared_ptr<AnyDie> Debug::signature_die(uint64_t signature) const {
+        dwarf::Dwarf_Sig8 sig;
+        std::memcpy(sig.signature, &signature, sizeof (sig.signature));
+
+        dwarf::Dwarf_Die die;
+        Dwarf::Error err;
+        switch (dwarf::dwarf_die_from_hash_signature(handle_, &sig, "tu", &die, &err)) {
+            case DW_DLV_NO_ENTRY: return nullptr;
+            case DW_DLV_ERROR: throw Exception(shared_from_this(), err);
+            default: break;
+        }
+        std::shared_ptr<const Debug> dbg = shared_from_this();
         return make_die(Die::get_tag_id(dbg, die), dbg, die);
     }
 
+    std::vector<std::shared_ptr<AnyDie>> Debug::offdie(const std::vector<Dwarf::Off>& offsets) const {
+        std::vector<std::shared_ptr<AnyDie>> result(offsets.size());
+
+        std::vector<size_t> order(offsets.size());
+        std::iota(order.begin(), order.end(), 0);
+        if (!std::is_sorted(offsets.begin(), offsets.end()))
+            std::stable_sort(order.begin(), order.end(), [&offsets](size_t a, size_t b) {
+                return offsets[a] < offsets[b];
+            });
+
+        // in section order libdwarf stays within one unit context for as
+        // long as possible, and repeated offsets are resolved only once
+        for (size_t i = 0; i < order.size(); ++i) {
+            if (i > 0 && offsets[order[i - 1]] == offsets[order[i]])
+                result[order[i]] = result[order[i - 1]];
+            else
+                result[order[i]] = offdie(offsets[order[i]]);
+        }
+        return result;
+    }
+
+    void Debug::set_die_cache_size(size_t entries) const {
+        die_cache_->set_capacity(entries);
+    }
+
 };
@@ -0,0 +1,229 @@
+/*
+ *  This file is part of libdwarf++.
+ *
+ *  Copyright © 2015 Frankin "Snaipe" Mathieu <http://snaipe.me>
+ *
+ *  libdwarf++ is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libdwarf++ is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libdwarf++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LIBDWARFPP_ELF_HH
+# define LIBDWARFPP_ELF_HH
+
+# include <algorithm>
+# include <cstddef>
+# include <cstdint>
+# include <cstring>
+# include <stdexcept>
+# include <string>
+# include <utility>
+# include <vector>
+# include <elf.h>
+# include "libdwarf++/cdwarf"
+# include "libdwarf++/span.hh"
+
+namespace Dwarf {
+
+    /* Lowercase hex encoding of bytes, as build-ids are usually printed. */
+    inline std::string to_hex(Span<const Dwarf::Small> bytes) {
+        static const char digits[] = "0123456789abcdef";
+        std::string out;
+        out.reserve(bytes.size() * 2);
+        for (Dwarf::Small b : bytes) {
+            out += digits[b >> 4];
+            out += digits[b & 0xf];
+        }
+        return out;
+    }
+
+    /*
+     * Section table of an ELF image held in memory, 32 or 64-bit, of
+     * either byte order. Section data is never copied: data() returns a
+     * view into the image.
+     */
+    class ElfImage {
+    public:
+        struct Section {
+            const char* name;
+            uint32_t type;
+            uint64_t flags;
+            uint64_t addr;
+            uint64_t offset;
+            uint64_t size;
+            uint32_t link;
+            uint32_t info;
+            uint64_t entsize;
+        };
+
+        explicit ElfImage(Span<const Dwarf::Small> bytes) : bytes_(bytes) {
+            if (bytes.size() < EI_NIDENT || std::memcmp(bytes.data(), ELFMAG, SELFMAG) != 0)
+                throw std::runtime_error("Not an ELF image");
+
+            is64_ = bytes[EI_CLASS] == ELFCLASS64;
+            if (!is64_ && bytes[EI_CLASS] != ELFCLASS32)
+                throw std::runtime_error("Unknown ELF class");
+            little_endian_ = bytes[EI_DATA] == ELFDATA2LSB;
+            if (!little_endian_ && bytes[EI_DATA] != ELFDATA2MSB)
+                throw std::runtime_error("Unknown ELF byte order");
+
+            if (is64_)
+                load<Elf64_Ehdr, Elf64_Shdr>();
+            else
+                load<Elf32_Ehdr, Elf32_Shdr>();
+        }
+
+        bool is64() const           { return is64_; }
+        bool little_endian() const  { return little_endian_; }
+
+        size_t section_count() const {
+            return sections_.size();
+        }
+
+        const Section& section(size_t index) const {
+            return sections_.at(index);
+        }
+
+        const std::vector<Section>& sections() const {
+            return sections_;
+        }
+
+        /* Index of the first section called name, or section_count(). */
+        size_t find(const char* name) const {
+            for (size_t i = 0; i < sections_.size(); ++i)
+                if (std::strcmp(sections_[i].name, name) == 0)
+                    return i;
+            return sections_.size();
+        }
+
+        /* Descriptor of the GNU build-id note, or an empty span. */
+        Span<const Dwarf::Small> build_id() const {
+            for (size_t i = 0; i < sections_.size(); ++i) {
+                if (sections_[i].type != SHT_NOTE)
+                    continue;
+
+                const uint64_t end = sections_[i].offset + sections_[i].size;
+                uint64_t at = sections_[i].offset;
+                while (end - at >= 12) {
+                    const uint32_t namesz = read<uint32_t>(at);
+                    const uint32_t descsz = read<uint32_t>(at + 4);
+                    const uint32_t type   = read<uint32_t>(at + 8);
+                    const uint64_t name   = at + 12;
+                    const uint64_t desc   = name + ((namesz + 3) & ~3u);
+                    const uint64_t next   = desc + ((descsz + 3) & ~static_cast<uint64_t>(3));
+                    if (next > end)
+                        break;
+                    if (type == NT_GNU_BUILD_ID && namesz == 4
+                            && std::memcmp(bytes_.data() + name, "GNU", 4) == 0)
+                        return bytes_.subspan(desc, descsz);
+                    at = next;
+                }
+            }
+            return Span<const Dwarf::Small>();
+        }
+
+        /* File contents of a section; empty for SHT_NOBITS. */
+        Span<const Dwarf::Small> data(size_t index) const {
+            const Section& s = section(index);
+            if (s.type == SHT_NOBITS)
+                return Span<const Dwarf::Small>();
+            return bytes_.subspan(s.offset, s.size);
+        }
+
+        /* Reads a header field, swapping it to host order if needed. */
+        template <typename T>
+        T read(uint64_t offset) const {
+            if (offset > bytes_.size() || bytes_.size() - offset < sizeof (T))
+                throw std::runtime_error("Malformed ELF image");
+            T v;
+            std::memcpy(&v, bytes_.data() + offset, sizeof (T));
+            return swap(v);
+        }
+
+    private:
+        bool host_order() const {
+            const uint16_t probe = 1;
+            return little_endian_ == (*reinterpret_cast<const uint8_t*>(&probe) == 1);
+        }
+
+        template <typename T>
+        T swap(T v) const {
+            if (host_order() || sizeof (T) == 1)
+                return v;
+            uint8_t b[sizeof (T)];
+            std::memcpy(b, &v, sizeof (T));
+            for (size_t i = 0; i < sizeof (T) / 2; ++i)
+                std::swap(b[i], b[sizeof (T) - i - 1]);
+            std::memcpy(&v, b, sizeof (T));
+            return v;
+        }
+
+        template <typename Ehdr, typename Shdr>
+        void load() {
+            const uint64_t shoff = read<decltype(Ehdr::e_shoff)>(offsetof(Ehdr, e_shoff));
+            uint64_t shnum = read<decltype(Ehdr::e_shnum)>(offsetof(Ehdr, e_shnum));
+            uint64_t shstrndx = read<decltype(Ehdr::e_shstrndx)>(offsetof(Ehdr, e_shstrndx));
+            if (shoff == 0)
+                return;
+
+            // large section counts and string table indices spill into
+            // the first section header
+            if (shnum == 0)
+                shnum = read<decltype(Shdr::sh_size)>(shoff + offsetof(Shdr, sh_size));
+            if (shstrndx == SHN_XINDEX)
+                shstrndx = read<decltype(Shdr::sh_link)>(shoff + offsetof(Shdr, sh_link));
+
+            if (shnum > (bytes_.size() - std::min<uint64_t>(shoff, bytes_.size())) / sizeof (Shdr))
+                throw std::runtime_error("Malformed ELF image");
+
+            sections_.reserve(shnum);
+            for (uint64_t i = 0; i < shnum; ++i) {
+                const uint64_t at = shoff + i * sizeof (Shdr);
+                Section s;
+                s.name    = nullptr;
+                s.type    = read<decltype(Shdr::sh_type)>(at + offsetof(Shdr, sh_type));
+                s.flags   = read<decltype(Shdr::sh_flags)>(at + offsetof(Shdr, sh_flags));
+                s.addr    = read<decltype(Shdr::sh_addr)>(at + offsetof(Shdr, sh_addr));
+                s.offset  = read<decltype(Shdr::sh_offset)>(at + offsetof(Shdr, sh_offset));
+                s.size    = read<decltype(Shdr::sh_size)>(at + offsetof(Shdr, sh_size));
+                s.link    = read<decltype(Shdr::sh_link)>(at + offsetof(Shdr, sh_link));
+                s.info    = read<decltype(Shdr::sh_info)>(at + offsetof(Shdr, sh_info));
+                s.entsize = read<decltype(Shdr::sh_entsize)>(at + offsetof(Shdr, sh_entsize));
+
+                if (s.type != SHT_NOBITS && (s.offset > bytes_.size() || bytes_.size() - s.offset < s.size))
+                    throw std::runtime_error("Malformed ELF image");
+                sections_.push_back(s);
+            }
+
+            static const char empty[] = "";
+            Span<const Dwarf::Small> strtab;
+            if (shstrndx < sections_.size())
+                strtab = data(shstrndx);
+
+            for (uint64_t i = 0; i < shnum; ++i) {
+                const uint32_t off = read<decltype(Shdr::sh_name)>(shoff + i * sizeof (Shdr) + offsetof(Shdr, sh_name));
+                const char* name = empty;
+                if (off < strtab.size() && std::memchr(strtab.data() + off, 0, strtab.size() - off))
+                    name = reinterpret_cast<const char*>(strtab.data() + off);
+                sections_[i].name = name;
+            }
+        }
+
+        Span<const Dwarf::Small> bytes_;
+        bool is64_;
+        bool little_endian_;
+        std::vector<Section> sections_;
+    };
+
+}
+
+#endif /* !LIBDWARFPP_ELF_HH */
@@ -0,0 +1,611 @@
+/*
+ *  This file is part of libdwarf++.
+ *
+ *  Copyright © 2015 Frankin "Snaipe" Mathieu <http://snaipe.me>
+ *
+ *  libdwarf++ is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libdwarf++ is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libdwarf++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include "libdwarf++/expression.hh"
+#include "libdwarf++/dwarf.hh"
+#include "reader.hh"
+
+namespace Dwarf {
+
+    constexpr size_t Expression::max_stack;
+
+    namespace {
+
+        class Stack {
+        public:
+            Stack() : size_(0) {}
+
+            void push(uint64_t v) {
+                if (size_ == Expression::max_stack)
+                    throw std::runtime_error("DWARF expression stack overflow");
+                data_[size_++] = v;
+            }
+
+            uint64_t pop() {
+                need(1);
+                return data_[--size_];
+            }
+
+            uint64_t& at(size_t depth) {
+                need(depth + 1);
+                return data_[size_ - depth - 1];
+            }
+
+            bool empty() const {
+                return size_ == 0;
+            }
+
+        private:
+            void need(size_t n) const {
+                if (size_ < n)
+                    throw std::runtime_error("DWARF expression stack underflow");
+            }
+
+            uint64_t data_[Expression::max_stack];
+            size_t size_;
+        };
+
+        /* Operations that depend on nothing but their operands and the
+         * stack, so that an expression made of them only can be folded. */
+        bool is_pure(Dwarf::Small code) {
+            switch (code) {
+                case DW_OP_lit0 ... DW_OP_lit31:
+                case DW_OP_addr:
+                case DW_OP_const1u:
+                case DW_OP_const1s:
+                case DW_OP_const2u:
+                case DW_OP_const2s:
+                case DW_OP_const4u:
+                case DW_OP_const4s:
+                case DW_OP_const8u:
+                case DW_OP_const8s:
+                case DW_OP_constu:
+                case DW_OP_consts:
+                case DW_OP_dup:
+                case DW_OP_drop:
+                case DW_OP_over:
+                case DW_OP_pick:
+                case DW_OP_swap:
+                case DW_OP_rot:
+                case DW_OP_abs:
+                case DW_OP_and:
+                case DW_OP_div:
+                case DW_OP_minus:
+                case DW_OP_mod:
+                case DW_OP_mul:
+                case DW_OP_neg:
+                case DW_OP_not:
+                case DW_OP_or:
+                case DW_OP_plus:
+                case DW_OP_plus_uconst:
+                case DW_OP_shl:
+                case DW_OP_shr:
+                case DW_OP_shra:
+                case DW_OP_xor:
+                case DW_OP_eq:
+                case DW_OP_ge:
+                case DW_OP_gt:
+                case DW_OP_le:
+                case DW_OP_lt:
+                case DW_OP_ne:
+                case DW_OP_skip:
+                case DW_OP_bra:
+                case DW_OP_nop:
+                case DW_OP_stack_value:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        /* Value of a DW_EH_PE encoded operand (DW_OP_GNU_encoded_addr). */
+        uint64_t read_encoded(Reader& r, Dwarf::Small encoding, Dwarf::Half address_size) {
+            switch (encoding & 0x0f) {
+                case 0x00: return r.fixed(address_size);
+                case 0x01: return r.uleb();
+                case 0x02: return r.fixed(2);
+                case 0x03: return r.fixed(4);
+                case 0x04: return r.fixed(8);
+                case 0x09: return r.sleb();
+                case 0x0a: return r.fixed_signed(2);
+                case 0x0b: return r.fixed_signed(4);
+                case 0x0c: return r.fixed(8);
+                default: throw std::runtime_error("Unknown pointer encoding in DWARF expression");
+            }
+        }
+
+        // Frame used without a context: memory is read from the current
+        // process and anything that depends on a frame is an error.
+        struct ProcessFrame {
+            uint64_t read(uint64_t addr, size_t size) {
+                uint64_t v = 0;
+                std::memcpy(&v, reinterpret_cast<const void*>(addr), std::min(size, sizeof (v)));
+                return v;
+            }
+
+            uint64_t reg(uint64_t)  { return missing(); }
+            uint64_t frame_base()   { return missing(); }
+            uint64_t cfa()          { return missing(); }
+
+            static uint64_t missing() {
+                throw std::runtime_error("DWARF expression needs a register context");
+            }
+        };
+
+        struct ContextFrame {
+            const Expression::Context& ctx;
+
+            uint64_t read(uint64_t addr, size_t size) {
+                if (ctx.read_memory)
+                    return ctx.read_memory(addr, size);
+                return ProcessFrame().read(addr, size);
+            }
+
+            uint64_t reg(uint64_t n) {
+                if (n >= ctx.registers.size())
+                    throw std::runtime_error("Register not available in context");
+                return ctx.registers[n];
+            }
+
+            uint64_t frame_base() {
+                if (!ctx.frame_base)
+                    throw std::runtime_error("No frame base in context");
+                return ctx.frame_base();
+            }
+
+            uint64_t cfa() {
+                if (!ctx.cfa)
+                    throw std::runtime_error("No CFA in context");
+                return ctx.cfa();
+            }
+        };
+
+#define BINOP(Type, Op) \
+    do {                                                            \
+        Type a = static_cast<Type>(stack.pop());                    \
+        Type b = static_cast<Type>(stack.pop());                    \
+        stack.push(static_cast<uint64_t>(b Op a));                  \
+    } while (0)
+
+        /*
+         * Runs the operations and returns the location of the whole object.
+         * Pieces split off with DW_OP_piece are appended to pieces, which may
+         * only be null for expressions that have none.
+         */
+        template <typename Frame>
+        Piece run(const std::vector<Expression::Op>& ops, Dwarf::Half address_size,
+                  Frame& frame, std::vector<Piece>* pieces) {
+            Stack stack;
+            Piece::Kind kind = Piece::MEMORY;
+            uint64_t value = 0;
+            uint64_t implicit_size = 0;
+
+            auto take = [&](uint64_t size, uint64_t offset) {
+                Piece p = { kind, value, size, offset };
+                if (kind == Piece::MEMORY || kind == Piece::VALUE) {
+                    if (stack.empty())
+                        p.kind = Piece::UNDEFINED;
+                    else
+                        p.value = stack.pop();
+                }
+                kind = Piece::MEMORY;
+                return p;
+            };
+
+            for (size_t pc = 0; pc < ops.size(); ) {
+                const Expression::Op& op = ops[pc++];
+                switch (op.code) {
+                    case DW_OP_lit0 ... DW_OP_lit31:
+                        stack.push(static_cast<uint64_t>(op.code - DW_OP_lit0));
+                        break;
+                    case DW_OP_addr:
+                    case DW_OP_const1s:
+                    case DW_OP_const1u:
+                    case DW_OP_const2s:
+                    case DW_OP_const2u:
+                    case DW_OP_const4s:
+                    case DW_OP_const4u:
+                    case DW_OP_const8s:
+                    case DW_OP_const8u:
+                    case DW_OP_consts:
+                    case DW_OP_constu:
+                        stack.push(op.a);
+                        break;
+
+                    case DW_OP_drop:
+                        stack.pop();
+                        break;
+                    case DW_OP_dup:
+                        stack.push(stack.at(0));
+                        break;
+                    case DW_OP_pick:
+                        stack.push(stack.at(op.a));
+                        break;
+                    case DW_OP_over:
+                        stack.push(stack.at(1));
+                        break;
+                    case DW_OP_swap:
+                        std::swap(stack.at(0), stack.at(1));
+                        break;
+                    case DW_OP_rot:
+                        std::swap(stack.at(0), stack.at(1));
+                        std::swap(stack.at(1), stack.at(2));
+                        break;
+
+                    case DW_OP_deref:
+                        stack.push(frame.read(stack.pop(), address_size));
+                        break;
+                    case DW_OP_deref_size:
+                        stack.push(frame.read(stack.pop(), op.a));
+                        break;
+
+                    case DW_OP_abs: {
+                        int64_t a = static_cast<int64_t>(stack.pop());
+                        stack.push(static_cast<uint64_t>(a < 0 ? -a : a));
+                    } break;
+                    case DW_OP_neg:
+                        stack.push(-stack.pop());
+                        break;
+                    case DW_OP_not:
+                        stack.push(~stack.pop());
+                        break;
+
+                    case DW_OP_div:
+                        if (stack.at(0) == 0)
+                            throw std::runtime_error("Division by zero in DWARF expression");
+                        BINOP(int64_t, /);
+                        break;
+                    case DW_OP_mod:
+                        if (stack.at(0) == 0)
+                            throw std::runtime_error("Division by zero in DWARF expression");
+                        BINOP(uint64_t, %);
+                        break;
+
+                    case DW_OP_and:     BINOP(uint64_t, &); break;
+                    case DW_OP_or:      BINOP(uint64_t, |); break;
+                    case DW_OP_xor:     BINOP(uint64_t, ^); break;
+                    case DW_OP_plus:    BINOP(uint64_t, +); break;
+                    case DW_OP_minus:   BINOP(uint64_t, -); break;
+                    case DW_OP_mul:     BINOP(uint64_t, *); break;
+                    case DW_OP_shl:     BINOP(uint64_t, <<); break;
+                    case DW_OP_shr:     BINOP(uint64_t, >>); break;
+                    case DW_OP_shra:    BINOP(int64_t, >>); break;
+
+                    case DW_OP_lt:      BINOP(int64_t, <); break;
+                    case DW_OP_le:      BINOP(int64_t, <=); break;
+                    case DW_OP_gt:      BINOP(int64_t, >); break;
+                    case DW_OP_ge:      BINOP(int64_t, >=); break;
+                    case DW_OP_eq:      BINOP(int64_t, ==); break;
+                    case DW_OP_ne:      BINOP(int64_t, !=); break;
+
+                    case DW_OP_plus_uconst:
+                        stack.push(stack.pop() + op.a);
+                        break;
+
+                    case DW_OP_skip:
+                        pc = op.b;
+                        break;
+                    case DW_OP_bra:
+                        if (stack.pop())
+                            pc = op.b;
+                        break;
+
+                    case DW_OP_breg0 ... DW_OP_breg31:
+                        stack.push(frame.reg(op.code - DW_OP_breg0) + op.a);
+                        break;
+                    case DW_OP_bregx:
+                        stack.push(frame.reg(op.a) + op.b);
+                        break;
+                    case DW_OP_fbreg:
+                        stack.push(frame.frame_base() + op.a);
+                        break;
+                    case DW_OP_call_frame_cfa:
+                        stack.push(frame.cfa());
+                        break;
+
+                    case DW_OP_reg0 ... DW_OP_reg31:
+                        kind = Piece::REGISTER;
+                        value = op.code - DW_OP_reg0;
+                        break;
+                    case DW_OP_regx:
+                        kind = Piece::REGISTER;
+                        value = op.a;
+                        break;
+                    case DW_OP_stack_value:
+                        kind = Piece::VALUE;
+                        break;
+                    case DW_OP_implicit_value:
+                        kind = Piece::IMPLICIT;
+                        value = op.b;
+                        implicit_size = op.a * 8;
+                        break;
+
+                    case DW_OP_piece:
+                    case DW_OP_bit_piece:
+                        if (!pieces)
+                            throw std::runtime_error("DWARF expression describes a composite location");
+                        if (op.code == DW_OP_piece)
+                            pieces->push_back(take(op.a * 8, 0));
+                        else
+                            pieces->push_back(take(op.a, op.b));
+                        break;
+
+                    case DW_OP_nop:
+                        break;
+
+                    default: throw std::runtime_error("Opcode not implemented");
+                }
+            }
+
+            if (pieces && !pieces->empty())
+                return Piece { Piece::UNDEFINED, 0, 0, 0 };
+            return take(kind == Piece::IMPLICIT ? implicit_size : 0, 0);
+        }
+
+#undef BINOP
+
+    }
+
+    Expression::Expression(Span<const Dwarf::Small> bytes, Dwarf::Half address_size, Dwarf::Half offset_size)
+        : constant_(false)
+        , constant_kind_(Piece::UNDEFINED)
+        , value_(0)
+        , address_size_(address_size)
+    {
+        Reader r(bytes);
+        std::vector<uint64_t> offsets;
+
+        // blocks are kept as a pointer into bytes, with their size in a
+        auto block = [&](Op& op, uint64_t size) {
+            op.a = size;
+            op.b = reinterpret_cast<uint64_t>(r.block(size).data());
+        };
+
+        while (!r.done()) {
+            offsets.push_back(r.offset());
+            Op op = { r.u8(), 0, 0 };
+
+            switch (op.code) {
+                case DW_OP_lit0 ... DW_OP_lit31:
+                case DW_OP_reg0 ... DW_OP_reg31:
+                case DW_OP_deref:
+                case DW_OP_dup:
+                case DW_OP_drop:
+                case DW_OP_over:
+                case DW_OP_swap:
+                case DW_OP_rot:
+                case DW_OP_xderef:
+                case DW_OP_abs:
+                case DW_OP_and:
+                case DW_OP_div:
+                case DW_OP_minus:
+                case DW_OP_mod:
+                case DW_OP_mul:
+                case DW_OP_neg:
+                case DW_OP_not:
+                case DW_OP_or:
+                case DW_OP_plus:
+                case DW_OP_shl:
+                case DW_OP_shr:
+                case DW_OP_shra:
+                case DW_OP_xor:
+                case DW_OP_eq:
+                case DW_OP_ge:
+                case DW_OP_gt:
+                case DW_OP_le:
+                case DW_OP_lt:
+                case DW_OP_ne:
+                case DW_OP_nop:
+                case DW_OP_push_object_address:
+                case DW_OP_form_tls_address:
+                case DW_OP_call_frame_cfa:
+                case DW_OP_stack_value:
+                case DW_OP_GNU_push_tls_address:
+                case DW_OP_GNU_uninit:
+                    break;
+
+                case DW_OP_addr:        op.a = r.fixed(address_size); break;
+                case DW_OP_const1u:     op.a = r.fixed(1); break;
+                case DW_OP_const1s:     op.a = r.fixed_signed(1); break;
+                case DW_OP_const2u:     op.a = r.fixed(2); break;
+                case DW_OP_const2s:     op.a = r.fixed_signed(2); break;
+                case DW_OP_const4u:     op.a = r.fixed(4); break;
+                case DW_OP_const4s:     op.a = r.fixed_signed(4); break;
+                case DW_OP_const8u:
+                case DW_OP_const8s:     op.a = r.fixed(8); break;
+                case DW_OP_constu:      op.a = r.uleb(); break;
+                case DW_OP_consts:      op.a = r.sleb(); break;
+                case DW_OP_pick:        op.a = r.fixed(1); break;
+                case DW_OP_plus_uconst: op.a = r.uleb(); break;
+                case DW_OP_skip:
+                case DW_OP_bra:         op.a = r.fixed_signed(2); break;
+                case DW_OP_breg0 ... DW_OP_breg31:
+                case DW_OP_fbreg:       op.a = r.sleb(); break;
+                case DW_OP_regx:        op.a = r.uleb(); break;
+                case DW_OP_bregx:       op.a = r.uleb(); op.b = r.sleb(); break;
+                case DW_OP_piece:       op.a = r.uleb(); break;
+                case DW_OP_bit_piece:   op.a = r.uleb(); op.b = r.uleb(); break;
+                case DW_OP_deref_size:
+                case DW_OP_xderef_size: op.a = r.fixed(1); break;
+                case DW_OP_call2:       op.a = r.fixed(2); break;
+                case DW_OP_call4:
+                case DW_OP_GNU_parameter_ref:
+                                        op.a = r.fixed(4); break;
+                case DW_OP_call_ref:
+                case DW_OP_GNU_variable_value:
+                                        op.a = r.fixed(offset_size); break;
+
+                case DW_OP_addrx:
+                case DW_OP_constx:
+                case DW_OP_GNU_addr_index:
+                case DW_OP_GNU_const_index:
+                case DW_OP_convert:
+                case DW_OP_reinterpret:
+                case DW_OP_GNU_convert:
+                case DW_OP_GNU_reinterpret:
+                                        op.a = r.uleb(); break;
+                case DW_OP_regval_type:
+                case DW_OP_GNU_regval_type:
+                                        op.a = r.uleb(); op.b = r.uleb(); break;
+                case DW_OP_deref_type:
+                case DW_OP_xderef_type:
+                case DW_OP_GNU_deref_type:
+                                        op.a = r.fixed(1); op.b = r.uleb(); break;
+                case DW_OP_implicit_pointer:
+                case DW_OP_GNU_implicit_pointer:
+                                        op.a = r.fixed(offset_size); op.b = r.sleb(); break;
+                case DW_OP_GNU_encoded_addr: {
+                    const Dwarf::Small encoding = r.u8();
+                    op.a = read_encoded(r, encoding, address_size);
+                    op.b = encoding;
+                } break;
+
+                case DW_OP_implicit_value:
+                case DW_OP_entry_value:
+                case DW_OP_GNU_entry_value:
+                    block(op, r.uleb());
+                    break;
+                case DW_OP_const_type:
+                case DW_OP_GNU_const_type:
+                    // the base type is not tracked, only the constant bytes
+                    r.uleb();
+                    block(op, r.u8());
+                    break;
+
+                default:
+                    throw std::runtime_error("Unknown DWARF expression opcode " + std::to_string(op.code));
+            }
+            ops_.push_back(op);
+        }
+
+        link(offsets);
+        fold();
+    }
+
+    Expression::Expression(const Dwarf::Loc* ops, size_t count, Dwarf::Half address_size)
+        : constant_(false)
+        , constant_kind_(Piece::UNDEFINED)
+        , value_(0)
+        , address_size_(address_size)
+    {
+        std::vector<uint64_t> offsets;
+        ops_.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            Op op = { ops[i].lr_atom, ops[i].lr_number, ops[i].lr_number2 };
+            if (op.code == DW_OP_skip || op.code == DW_OP_bra)
+                op.a = static_cast<int16_t>(op.a);
+            ops_.push_back(op);
+            offsets.push_back(ops[i].lr_offset);
+        }
+
+        link(offsets);
+        fold();
+    }
+
+    void Expression::link(const std::vector<uint64_t>& offsets) {
+        for (size_t i = 0; i < ops_.size(); ++i) {
+            Op& op = ops_[i];
+            if (op.code != DW_OP_skip && op.code != DW_OP_bra)
+                continue;
+
+            // branches are 3 bytes long and relative to the next operation
+            uint64_t target = offsets[i] + 3 + op.a;
+            auto it = std::lower_bound(offsets.begin(), offsets.end(), target);
+            if (it == offsets.end())
+                op.b = ops_.size();
+            else if (*it == target)
+                op.b = static_cast<uint64_t>(it - offsets.begin());
+            else
+                throw std::runtime_error("DWARF expression branches into an operand");
+        }
+    }
+
+    void Expression::fold() {
+        for (const Op& op : ops_)
+            if (!is_pure(op.code))
+                return;
+
+        try {
+            ProcessFrame frame;
+            Piece p = run(ops_, address_size_, frame, nullptr);
+            constant_kind_ = p.kind;
+            value_ = p.value;
+            constant_ = p.kind == Piece::MEMORY || p.kind == Piece::VALUE;
+        } catch (std::exception&) {
+            // leave it to evaluate() to report the error
+        }
+    }
+
+    uint64_t Expression::evaluate() const {
+        if (constant_)
+            return value_;
+
+        ProcessFrame frame;
+        Piece p = run(ops_, address_size_, frame, nullptr);
+        if (p.kind != Piece::MEMORY && p.kind != Piece::VALUE)
+            throw std::runtime_error("DWARF expression does not compute a value");
+        return p.value;
+    }
+
+    Location Expression::evaluate(const Context& ctx) const {
+        Location loc;
+        if (constant_) {
+            loc.pieces.push_back(Piece { constant_kind_, value_, 0, 0 });
+            return loc;
+        }
+
+        ContextFrame frame { ctx };
+        Piece p = run(ops_, address_size_, frame, &loc.pieces);
+        if (loc.pieces.empty())
+            loc.pieces.push_back(p);
+        return loc;
+    }
+
+    std::vector<Location> Expression::evaluate(Span<const Context> frames) const {
+        std::vector<Location> locs;
+        locs.reserve(frames.size());
+        for (const Context& ctx : frames)
+            locs.push_back(evaluate(ctx));
+        return locs;
+    }
+
+    Dwarf::Half Debug::address_size() const {
+        if (!address_size_) {
+            Error err;
+            if (dwarf::dwarf_get_address_size(handle_, &address_size_, &err) == DW_DLV_ERROR)
+                throw Exception(shared_from_this(), err);
+        }
+        return address_size_;
+    }
+
+    std::shared_ptr<const Expression> Debug::expression(Span<const Dwarf::Small> bytes) const {
+        auto it = expressions_.find(bytes.data());
+        if (it != expressions_.end())
+            return it->second;
+
+        auto expr = std::make_shared<const Expression>(bytes, address_size());
+        expressions_.emplace(bytes.data(), expr);
+        return expr;
+    }
+
+}
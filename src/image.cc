@@ -0,0 +1,265 @@
+/*
+ *  This file is part of libdwarf++.
+ *
+ *  Copyright © 2015 Frankin "Snaipe" Mathieu <http://snaipe.me>
+ *
+ *  libdwarf++ is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libdwarf++ is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libdwarf++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "image.hh"
+#include "compress.hh"
+
+namespace Dwarf {
+
+    namespace {
+
+        const ObjectImage& image_of(void* obj) {
+            return *static_cast<const ObjectImage*>(obj);
+        }
+
+        int get_section_info(void* obj, Dwarf::Half index, dwarf::Dwarf_Obj_Access_Section* ret, int* error) {
+            const ObjectImage& image = image_of(obj);
+            if (index >= image.section_count()) {
+                *error = DW_DLE_MDE;
+                return DW_DLV_ERROR;
+            }
+
+            const ElfImage::Section& s = image.section(index);
+            ret->addr      = s.addr;
+            ret->type      = s.type;
+            ret->size      = s.size;
+            ret->name      = s.name;
+            ret->link      = s.link;
+            ret->info      = s.info;
+            ret->entrysize = s.entsize;
+            return DW_DLV_OK;
+        }
+
+        dwarf::Dwarf_Endianness get_byte_order(void* obj) {
+            return image_of(obj).elf().little_endian() ? dwarf::DW_OBJECT_LSB : dwarf::DW_OBJECT_MSB;
+        }
+
+        Dwarf::Small get_length_size(void* obj) {
+            return image_of(obj).elf().is64() ? 8 : 4;
+        }
+
+        Dwarf::Small get_pointer_size(void* obj) {
+            return image_of(obj).elf().is64() ? 8 : 4;
+        }
+
+        Dwarf::Unsigned get_section_count(void* obj) {
+            return image_of(obj).section_count();
+        }
+
+        int load_section(void* obj, Dwarf::Half index, Dwarf::Small** ret, int* error) {
+            const ObjectImage& image = image_of(obj);
+            if (index >= image.section_count() || image.section(index).type == SHT_NOBITS) {
+                *error = DW_DLE_MDE;
+                return DW_DLV_ERROR;
+            }
+
+            // libdwarf only writes to sections it relocates, and no
+            // relocations are applied, so handing out the image is safe
+            *ret = const_cast<Dwarf::Small*>(image.section_data(index).data());
+            return DW_DLV_OK;
+        }
+
+        const dwarf::Dwarf_Obj_Access_Methods methods = {
+            get_section_info,
+            get_byte_order,
+            get_length_size,
+            get_pointer_size,
+            get_section_count,
+            load_section,
+            nullptr,
+        };
+
+    }
+
+    ObjectImage::ObjectImage(Span<const Dwarf::Small> bytes, void* mapping, size_t mapping_size)
+        : bytes_(bytes)
+        , mapping_(mapping)
+        , mapping_size_(mapping_size)
+        , elf_(bytes)
+        , sections_(elf_.sections())
+    {
+        data_.reserve(sections_.size());
+        for (size_t i = 0; i < sections_.size(); ++i)
+            data_.push_back(elf_.data(i));
+
+        iface_.object = this;
+        iface_.methods = &methods;
+    }
+
+    ObjectImage::~ObjectImage() {
+        if (mapping_)
+            ::munmap(mapping_, mapping_size_);
+    }
+
+    std::shared_ptr<ObjectImage> ObjectImage::borrow(Span<const Dwarf::Small> bytes) {
+        std::shared_ptr<ObjectImage> image(new ObjectImage(bytes, nullptr, 0));
+        image->decompress(Debug::MapOptions());
+        return image;
+    }
+
+    std::shared_ptr<ObjectImage> ObjectImage::map(const char* path, const Debug::MapOptions& options) {
+        const Debug::Preload preload = options.preload;
+        int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+        if (fd == -1)
+            return nullptr;
+
+        struct stat st;
+        if (::fstat(fd, &st) == -1 || st.st_size == 0) {
+            ::close(fd);
+            return nullptr;
+        }
+
+        int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+        if (preload == Debug::Preload::POPULATE)
+            flags |= MAP_POPULATE;
+#endif
+        const size_t size = static_cast<size_t>(st.st_size);
+        void* mapping = ::mmap(nullptr, size, PROT_READ, flags, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED)
+            return nullptr;
+
+        std::shared_ptr<ObjectImage> image;
+        try {
+            image.reset(new ObjectImage(Span<const Dwarf::Small>(static_cast<const Dwarf::Small*>(mapping), size),
+                                        mapping, size));
+        } catch (...) {
+            ::munmap(mapping, size);
+            throw;
+        }
+        image->preload(preload);
+        image->decompress(options);
+        return image;
+    }
+
+    void ObjectImage::decompress(const Debug::MapOptions& options) {
+        std::vector<CompressedSection> compressed;
+        for (size_t i = 0; i < elf_.section_count(); ++i) {
+            CompressedSection c;
+            if (find_compressed(elf_, i, c))
+                compressed.push_back(std::move(c));
+        }
+        if (compressed.empty())
+            return;
+
+        SectionCache cache(options.cache_dir, elf_.build_id(), options.verify_cache);
+        std::vector<CompressedSection*> misses;
+        for (CompressedSection& c : compressed) {
+            if (cache.enabled())
+                c.checksum = checksum(c.payload);
+            if (!cache.load(c))
+                misses.push_back(&c);
+        }
+
+        Dwarf::decompress(misses, options.threads);
+        for (const CompressedSection* c : misses)
+            cache.store(*c);
+
+        names_.resize(sections_.size());
+        for (CompressedSection& c : compressed) {
+            ElfImage::Section& s = sections_[c.index];
+            names_[c.index] = c.name;
+            s.name = names_[c.index].c_str();
+            s.size = c.size;
+            s.flags &= ~static_cast<uint64_t>(SHF_COMPRESSED);
+            data_[c.index] = c.data;
+            owned_.push_back(std::move(c.owner));
+        }
+    }
+
+    void ObjectImage::preload(Debug::Preload preload) const {
+        if (preload == Debug::Preload::NONE || !mapping_)
+            return;
+#ifdef MAP_POPULATE
+        if (preload == Debug::Preload::POPULATE)
+            return;
+#endif
+
+        // only the sections libdwarf reads are worth prefetching
+        const uintptr_t page = static_cast<uintptr_t>(::sysconf(_SC_PAGESIZE));
+        for (const ElfImage::Section& s : elf_.sections()) {
+            if (s.type == SHT_NOBITS || s.size == 0)
+                continue;
+            if (std::strncmp(s.name, ".debug_", 7) != 0 && std::strncmp(s.name, ".zdebug_", 8) != 0
+                    && std::strcmp(s.name, ".eh_frame") != 0)
+                continue;
+
+            uintptr_t begin = reinterpret_cast<uintptr_t>(bytes_.data() + s.offset) & ~(page - 1);
+            uintptr_t end = reinterpret_cast<uintptr_t>(bytes_.data() + s.offset + s.size);
+            ::madvise(reinterpret_cast<void*>(begin), end - begin, MADV_WILLNEED);
+        }
+    }
+
+    std::shared_ptr<const Debug> Debug::open_mapped(const char* path, const MapOptions& options) {
+        std::shared_ptr<ObjectImage> image = ObjectImage::map(path, options);
+        if (!image)
+            return nullptr;
+        return make(new Debug(image), path);
+    }
+
+    std::shared_ptr<const Debug> Debug::open_mapped(const char* path, Preload preload) {
+        MapOptions options;
+        options.preload = preload;
+        return open_mapped(path, options);
+    }
+
+    std::shared_ptr<const Debug> Debug::from_memory(Span<const Dwarf::Small> bytes) {
+        return make(new Debug(ObjectImage::borrow(bytes)), "");
+    }
+
+    const std::string& Debug::build_id() const {
+        if (build_id_loaded_)
+            return build_id_;
+        build_id_loaded_ = true;
+
+        if (image_) {
+            build_id_ = to_hex(image_->elf().build_id());
+            return build_id_;
+        }
+
+        // handles opened from a descriptor have no image: map the file just
+        // long enough to read the note
+        int fd = path_.empty() ? -1 : ::open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1)
+            return build_id_;
+
+        struct stat st;
+        void* map = MAP_FAILED;
+        if (::fstat(fd, &st) == 0 && st.st_size > 0)
+            map = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED)
+            return build_id_;
+
+        try {
+            ElfImage elf(Span<const Dwarf::Small>(static_cast<const Dwarf::Small*>(map), st.st_size));
+            build_id_ = to_hex(elf.build_id());
+        } catch (const std::runtime_error&) {
+        }
+        ::munmap(map, st.st_size);
+        return build_id_;
+    }
+
+}
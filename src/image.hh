@@ -0,0 +1,98 @@
+/*
+ *  This file is part of libdwarf++.
+ *
+ *  Copyright © 2015 Frankin "Snaipe" Mathieu <http://snaipe.me>
+ *
+ *  libdwarf++ is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libdwarf++ is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libdwarf++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LIBDWARFPP_IMAGE_HH
+# define LIBDWARFPP_IMAGE_HH
+
+# include <memory>
+# include <string>
+# include <vector>
+# include "libdwarf++/dwarf.hh"
+# include "elf.hh"
+
+namespace Dwarf {
+
+    /*
+     * ELF image served to libdwarf through its object access interface,
+     * either mapped from a file or borrowed from the caller. Section loads
+     * hand out pointers into the image, and every handle opened on the
+     * same image shares it.
+     */
+    class ObjectImage {
+    public:
+        /* Maps path read-only; nullptr if it cannot be opened or mapped. */
+        static std::shared_ptr<ObjectImage> map(const char* path, const Debug::MapOptions& options);
+
+        /* Wraps bytes owned by the caller. */
+        static std::shared_ptr<ObjectImage> borrow(Span<const Dwarf::Small> bytes);
+
+        ~ObjectImage();
+
+        ObjectImage(const ObjectImage&) = delete;
+        ObjectImage& operator=(const ObjectImage&) = delete;
+
+        /* Interface to pass to dwarf_object_init. */
+        dwarf::Dwarf_Obj_Access_Interface* interface() const {
+            return &iface_;
+        }
+
+        const ElfImage& elf() const {
+            return elf_;
+        }
+
+        /*
+         * Section table as libdwarf sees it: compressed sections have
+         * their decompressed name, size and contents.
+         */
+        size_t section_count() const {
+            return sections_.size();
+        }
+
+        const ElfImage::Section& section(size_t index) const {
+            return sections_.at(index);
+        }
+
+        Span<const Dwarf::Small> section_data(size_t index) const {
+            return data_.at(index);
+        }
+
+        Span<const Dwarf::Small> bytes() const {
+            return bytes_;
+        }
+
+    private:
+        ObjectImage(Span<const Dwarf::Small> bytes, void* mapping, size_t mapping_size);
+
+        void preload(Debug::Preload preload) const;
+        void decompress(const Debug::MapOptions& options);
+
+        Span<const Dwarf::Small> bytes_;
+        void* mapping_;
+        size_t mapping_size_;
+        ElfImage elf_;
+        std::vector<ElfImage::Section> sections_;
+        std::vector<Span<const Dwarf::Small>> data_;
+        std::vector<std::string> names_;
+        std::vector<std::shared_ptr<const void>> owned_;
+        mutable dwarf::Dwarf_Obj_Access_Interface iface_;
+    };
+
+}
+
+#endif /* !LIBDWARFPP_IMAGE_HH */
@@ -0,0 +1,287 @@
+/*
+ *  This file is part of libdwarf++.
+ *
+ *  Copyright © 2015 Frankin "Snaipe" Mathieu <http://snaipe.me>
+ *
+ *  libdwarf++ is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libdwarf++ is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libdwarf++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <cerrno>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "libdwarf++/dwarf.hh"
+#include "indexfile.hh"
+
+namespace Dwarf {
+
+    constexpr uint32_t IndexFile::version;
+
+    static const char magic[8] = { 'D', 'W', 'P', 'P', 'I', 'D', 'X', '\0' };
+    static const uint32_t byte_order = 0x01020304;
+
+    static uint64_t align(uint64_t v) {
+        return (v + 15) & ~static_cast<uint64_t>(15);
+    }
+
+    static bool same_header(const CUHeader& a, const CUHeader& b) {
+        return a.offset == b.offset && a.length == b.length && a.version == b.version
+            && a.abbrev_offset == b.abbrev_offset && a.address_size == b.address_size
+            && a.die_offset == b.die_offset;
+    }
+
+    IndexFile::IndexFile(void* map, size_t size)
+        : map_(map)
+        , size_(size)
+    {
+        const Header* h = static_cast<const Header*>(map_);
+        sections_ = reinterpret_cast<const Section*>(h + 1);
+        section_count_ = h->section_count;
+    }
+
+    IndexFile::~IndexFile() {
+        ::munmap(map_, size_);
+    }
+
+    std::shared_ptr<const IndexFile> IndexFile::load(const std::string& path, const std::string& build_id) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1)
+            return nullptr;
+
+        struct stat st;
+        void* map = MAP_FAILED;
+        if (::fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof (Header))
+            map = ::mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED)
+            return nullptr;
+
+        const size_t size = static_cast<size_t>(st.st_size);
+        const Header* h = static_cast<const Header*>(map);
+
+        bool valid = std::memcmp(h->magic, magic, sizeof (magic)) == 0
+                && h->version == version
+                && h->byte_order == byte_order
+                && h->build_id_size == build_id.size()
+                && build_id.size() <= sizeof (h->build_id)
+                && std::memcmp(h->build_id, build_id.data(), build_id.size()) == 0
+                && h->section_count <= (size - sizeof (Header)) / sizeof (Section);
+
+        if (valid) {
+            const Section* sections = reinterpret_cast<const Section*>(h + 1);
+            for (uint32_t i = 0; i < h->section_count && valid; ++i) {
+                const Section& s = sections[i];
+                valid = s.elem_size != 0
+                        && s.offset <= size
+                        && s.count <= (size - s.offset) / s.elem_size;
+            }
+        }
+
+        if (!valid) {
+            ::munmap(map, size);
+            return nullptr;
+        }
+        return std::shared_ptr<const IndexFile>(new IndexFile(map, size));
+    }
+
+    namespace {
+
+        struct Blob {
+            IndexFile::Kind kind;
+            uint32_t elem_size;
+            const void* data;
+            uint64_t count;
+        };
+
+        template <typename T>
+        Blob blob(IndexFile::Kind kind, Span<const T> data) {
+            return Blob { kind, sizeof (T), data.data(), data.size() };
+        }
+
+        bool write_all(int fd, const void* data, size_t size) {
+            const char* p = static_cast<const char*>(data);
+            while (size) {
+                ssize_t n = ::write(fd, p, size);
+                if (n == -1 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                    return false;
+                p += n;
+                size -= static_cast<size_t>(n);
+            }
+            return true;
+        }
+
+    }
+
+    bool IndexFile::write(const std::string& path, const std::string& build_id,
+                          Span<const CUHeader> cus, const NameIndex* names, const AddressIndex* addrs,
+                          const TypeIndex* types) {
+        if (build_id.size() > sizeof (Header::build_id))
+            return false;
+
+        std::vector<Blob> blobs;
+        blobs.push_back(blob(CU_HEADERS, cus));
+        if (names) {
+            blobs.push_back(blob(NAME_ENTRIES, names->entries()));
+            blobs.push_back(blob(NAME_BUCKETS, names->buckets()));
+            blobs.push_back(blob(NAME_POOL,    names->pool()));
+        }
+        if (addrs) {
+            blobs.push_back(blob(ADDR_ENTRIES, addrs->entries()));
+            blobs.push_back(blob(ADDR_SCOPES,  addrs->scopes()));
+            blobs.push_back(blob(ADDR_UNITS,   addrs->units()));
+        }
+        if (types) {
+            blobs.push_back(blob(TYPE_ENTRIES, types->entries()));
+            blobs.push_back(blob(TYPE_ALIASES, types->aliases()));
+        }
+        const uint32_t count = static_cast<uint32_t>(blobs.size());
+
+        Header h;
+        std::memset(&h, 0, sizeof (h));
+        std::memcpy(h.magic, magic, sizeof (magic));
+        h.version = version;
+        h.byte_order = byte_order;
+        h.section_count = count;
+        h.build_id_size = static_cast<uint32_t>(build_id.size());
+        std::memcpy(h.build_id, build_id.data(), build_id.size());
+
+        std::vector<Section> table;
+        uint64_t offset = align(sizeof (Header) + count * sizeof (Section));
+        for (const Blob& b : blobs) {
+            table.push_back(Section { b.kind, b.elem_size, offset, b.count });
+            offset = align(offset + b.elem_size * b.count);
+        }
+
+        // write aside under a unique name and rename, so that concurrent
+        // loaders only ever see complete files and writers never collide
+        std::vector<char> tmp(path.begin(), path.end());
+        const char suffix[] = ".tmp.XXXXXX";
+        tmp.insert(tmp.end(), suffix, suffix + sizeof (suffix));
+        int fd = ::mkstemp(tmp.data());
+        if (fd == -1)
+            return false;
+        ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+        ::fchmod(fd, 0644);
+
+        static const char zeros[16] = {};
+        bool ok = write_all(fd, &h, sizeof (h))
+               && write_all(fd, table.data(), table.size() * sizeof (Section));
+        uint64_t pos = sizeof (h) + table.size() * sizeof (Section);
+        for (uint32_t i = 0; i < count && ok; ++i) {
+            ok = write_all(fd, zeros, table[i].offset - pos)
+              && write_all(fd, blobs[i].data, blobs[i].elem_size * blobs[i].count);
+            pos = table[i].offset + blobs[i].elem_size * blobs[i].count;
+        }
+        ok = ::close(fd) == 0 && ok;
+
+        if (!ok || ::rename(tmp.data(), path.c_str()) == -1) {
+            ::unlink(tmp.data());
+            return false;
+        }
+        return true;
+    }
+
+    void Debug::set_index_cache(const std::string& dir) const {
+        index_dir_ = dir;
+        index_file_ = nullptr;
+
+        const std::string& id = build_id();
+        if (dir.empty() || id.empty())
+            return;
+
+        std::shared_ptr<const IndexFile> file = IndexFile::load(dir + "/" + id + ".idx", id);
+        if (!file)
+            return;
+
+        Span<const CUHeader> cus = file->get<CUHeader>(IndexFile::CU_HEADERS);
+        if (cus.empty())
+            return;
+
+        // units handed out already are referenced by callers: keep them,
+        // and only trust a file that describes the same units
+        if (cus_loaded_) {
+            if (cus.size() != cu_headers_.size())
+                return;
+            for (size_t i = 0; i < cus.size(); ++i)
+                if (!same_header(cus[i], cu_headers_[i]))
+                    return;
+        }
+
+        // only the indexes that were built when the file was saved are in
+        // it; the others are built on first use as usual. The contents are
+        // checked before anything is used, and a file with any table out
+        // of shape is ignored as a whole
+        std::shared_ptr<NameIndex> names;
+        std::shared_ptr<AddressIndex> addrs;
+        std::shared_ptr<TypeIndex> types;
+        if (file->has(IndexFile::NAME_ENTRIES)) {
+            names = std::make_shared<NameIndex>(
+                    file->get<NameIndex::Entry>(IndexFile::NAME_ENTRIES),
+                    file->get<uint32_t>(IndexFile::NAME_BUCKETS),
+                    file->get<char>(IndexFile::NAME_POOL),
+                    file);
+            if (!names->valid(cus.size()))
+                return;
+        }
+        if (file->has(IndexFile::ADDR_ENTRIES)) {
+            addrs = std::make_shared<AddressIndex>(*this,
+                    file->get<AddressIndex::Entry>(IndexFile::ADDR_ENTRIES),
+                    file->get<AddressIndex::Segment>(IndexFile::ADDR_SCOPES),
+                    file->get<AddressIndex::Segment>(IndexFile::ADDR_UNITS),
+                    file);
+            if (!addrs->valid(cus.size()))
+                return;
+        }
+        if (file->has(IndexFile::TYPE_ENTRIES)) {
+            types = std::make_shared<TypeIndex>(
+                    file->get<TypeIndex::Entry>(IndexFile::TYPE_ENTRIES),
+                    file->get<TypeIndex::Alias>(IndexFile::TYPE_ALIASES),
+                    file);
+            if (!types->valid(cus.size()))
+                return;
+        }
+
+        if (!cus_loaded_) {
+            cu_headers_.assign(cus.begin(), cus.end());
+            cus_.assign(cu_headers_.size(), nullptr);
+            cus_loaded_ = true;
+        }
+
+        if (names)
+            name_index_ = names;
+        if (addrs)
+            address_index_ = addrs;
+        if (types)
+            type_index_ = types;
+        index_file_ = file;
+    }
+
+    void Debug::save_index() const {
+        if (index_dir_.empty() || build_id().empty())
+            return;
+
+        // called whenever an index is built: the file is rewritten with
+        // every index built or loaded so far, and none is built just for it
+        ::mkdir(index_dir_.c_str(), 0755);
+        IndexFile::write(index_dir_ + "/" + build_id() + ".idx", build_id(),
+                         Span<const CUHeader>(cu_headers_.data(), cu_headers_.size()),
+                         name_index_.get(), address_index_.get(), type_index_.get());
+    }
+
+}
@@ -0,0 +1,116 @@
+/*
+ *  This file is part of libdwarf++.
+ *
+ *  Copyright © 2015 Frankin "Snaipe" Mathieu <http://snaipe.me>
+ *
+ *  libdwarf++ is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libdwarf++ is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libdwarf++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LIBDWARFPP_INDEXFILE_HH
+# define LIBDWARFPP_INDEXFILE_HH
+
+# include <cstdint>
+# include <memory>
+# include <string>
+# include "libdwarf++/cu.hh"
+# include "libdwarf++/addrindex.hh"
+# include "libdwarf++/nameindex.hh"
+# include "libdwarf++/typeindex.hh"
+
+namespace Dwarf {
+
+    /*
+     * Read-only mapping of a persisted index: a header naming the build-id
+     * it was made for, a table of sections, and the raw arrays of the unit
+     * table and of the name, address and type indexes, each aligned so
+     * they can be used in place. The file is specific to the host ABI;
+     * anything that does not match is treated as missing.
+     */
+    class IndexFile {
+    public:
+        enum Kind : uint32_t {
+            CU_HEADERS = 1,
+            NAME_ENTRIES,
+            NAME_BUCKETS,
+            NAME_POOL,
+            ADDR_ENTRIES,
+            ADDR_SCOPES,
+            ADDR_UNITS,
+            TYPE_ENTRIES,
+            TYPE_ALIASES,
+        };
+
+        static constexpr uint32_t version = 2;
+
+        /* Maps path; nullptr if it is missing, malformed, from another
+         * format version, or was made for another build-id. */
+        static std::shared_ptr<const IndexFile> load(const std::string& path, const std::string& build_id);
+
+        /* Writes an index file atomically, with the indexes that are not
+         * nullptr. Returns false on I/O errors. */
+        static bool write(const std::string& path, const std::string& build_id,
+                          Span<const CUHeader> cus, const NameIndex* names, const AddressIndex* addrs,
+                          const TypeIndex* types);
+
+        ~IndexFile();
+
+        IndexFile(const IndexFile&) = delete;
+        IndexFile& operator=(const IndexFile&) = delete;
+
+        bool has(Kind kind) const {
+            for (uint32_t i = 0; i < section_count_; ++i)
+                if (sections_[i].kind == kind)
+                    return true;
+            return false;
+        }
+
+        /* Section of the given kind, empty if there is none. */
+        template <typename T>
+        Span<const T> get(Kind kind) const {
+            for (uint32_t i = 0; i < section_count_; ++i) {
+                const Section& s = sections_[i];
+                if (s.kind == kind && s.elem_size == sizeof (T) && s.offset % alignof (T) == 0)
+                    return Span<const T>(reinterpret_cast<const T*>(static_cast<const char*>(map_) + s.offset), s.count);
+            }
+            return Span<const T>();
+        }
+
+    private:
+        struct Header {
+            char magic[8];
+            uint32_t version;
+            uint32_t byte_order;
+            uint32_t section_count;
+            uint32_t build_id_size;
+            char build_id[64];
+        };
+
+        struct Section {
+            uint32_t kind;
+            uint32_t elem_size;
+            uint64_t offset;
+            uint64_t count;
+        };
+
+        IndexFile(void* map, size_t size);
+
+        void* map_;
+        size_t size_;
+        const Section* sections_;
+        uint32_t section_count_;
+    };
+
+}
+
+#endif /* !LIBDWARFPP_INDEXFILE_HH */
@@ -0,0 +1,195 @@
+/*
+ *  This file is part of libdwarf++.
+ *
+ *  Copyright © 2015 Frankin "Snaipe" Mathieu <http://snaipe.me>
+ *
+ *  libdwarf++ is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libdwarf++ is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libdwarf++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <algorithm>
+#include <unordered_map>
+#include "libdwarf++/linetable.hh"
+#include "libdwarf++/addrindex.hh"
+#include "libdwarf++/cu.hh"
+#include "reader.hh"
+
+namespace Dwarf {
+
+    /* Version of the line program header cu_die points to with
+     * DW_AT_stmt_list, which need not be that of the unit; fallback if it
+     * cannot be read. */
+    static Dwarf::Half line_version(const Debug& dbg, dwarf::Dwarf_Die cu_die, Dwarf::Half fallback) {
+        Error err;
+        dwarf::Dwarf_Attribute attr;
+        if (dwarf::dwarf_attr(cu_die, DW_AT_stmt_list, &attr, &err) != DW_DLV_OK)
+            return fallback;
+        Dwarf::Off offset = 0;
+        int res = dwarf::dwarf_global_formref(attr, &offset, &err);
+        dbg.dealloc(attr);
+        if (res != DW_DLV_OK)
+            return fallback;
+
+        Span<const Dwarf::Small> lines = dbg.raw_section(".debug_line");
+        if (lines.empty())
+            lines = dbg.raw_section(".debug_line.dwo");
+        if (offset >= lines.size() || lines.size() - offset < 6)
+            return fallback;
+
+        Reader r(lines);
+        r.seek(offset);
+        if (r.fixed(4) == 0xffffffff) {
+            if (lines.size() - offset < 14)
+                return fallback;
+            r.skip(8);
+        }
+        return static_cast<Dwarf::Half>(r.fixed(2));
+    }
+
+    LineTable::LineTable(const Debug& dbg, dwarf::Dwarf_Die cu_die, Dwarf::Half unit_version) {
+        Error err;
+
+        // file numbers of the line program index the dwarf_srcfiles list,
+        // from 1 up to DWARF 4 and from 0 since DWARF 5 line tables; map
+        // them to interned names
+        std::vector<uint32_t> file_map;
+        if (line_version(dbg, cu_die, unit_version) < 5)
+            file_map.push_back(0);
+        files_.emplace_back("");
+
+        char** srcfiles;
+        Dwarf::Signed nfiles;
+        switch (dwarf::dwarf_srcfiles(cu_die, &srcfiles, &nfiles, &err)) {
+            case DW_DLV_ERROR: throw Exception(dbg.shared_from_this(), err);
+            case DW_DLV_NO_ENTRY: nfiles = 0; break;
+            default: {
+                std::unordered_map<std::string, uint32_t> interned;
+                for (Dwarf::Signed i = 0; i < nfiles; ++i) {
+                    auto res = interned.emplace(srcfiles[i], static_cast<uint32_t>(files_.size()));
+                    if (res.second)
+                        files_.emplace_back(srcfiles[i]);
+                    file_map.push_back(res.first->second);
+                    dbg.dealloc(srcfiles[i]);
+                }
+                dbg.dealloc(srcfiles);
+            }
+        }
+
+        dwarf::Dwarf_Line* lines;
+        Dwarf::Signed nlines;
+        switch (dwarf::dwarf_srclines(cu_die, &lines, &nlines, &err)) {
+            case DW_DLV_ERROR: throw Exception(dbg.shared_from_this(), err);
+            case DW_DLV_NO_ENTRY: return;
+            default: break;
+        }
+
+        rows_.reserve(static_cast<size_t>(nlines));
+        for (Dwarf::Signed i = 0; i < nlines; ++i) {
+            Dwarf::Addr addr;
+            Dwarf::Unsigned lineno, column, fileno;
+            Dwarf::Bool end_sequence, is_stmt;
+            if (dwarf::dwarf_lineaddr(lines[i], &addr, &err) == DW_DLV_ERROR
+                    || dwarf::dwarf_lineno(lines[i], &lineno, &err) == DW_DLV_ERROR
+                    || dwarf::dwarf_lineoff_b(lines[i], &column, &err) == DW_DLV_ERROR
+                    || dwarf::dwarf_line_srcfileno(lines[i], &fileno, &err) == DW_DLV_ERROR
+                    || dwarf::dwarf_lineendsequence(lines[i], &end_sequence, &err) == DW_DLV_ERROR
+                    || dwarf::dwarf_linebeginstatement(lines[i], &is_stmt, &err) == DW_DLV_ERROR) {
+                dwarf::dwarf_srclines_dealloc(dbg.get_handle(), lines, nlines);
+                throw Exception(dbg.shared_from_this(), err);
+            }
+
+            Row row;
+            row.addr = addr;
+            row.line = static_cast<uint32_t>(lineno);
+            row.file = fileno < file_map.size() ? file_map[fileno] : 0;
+            row.column = std::min<Dwarf::Unsigned>(column, (1u << 30) - 1);
+            row.is_stmt = !!is_stmt;
+            row.end_sequence = !!end_sequence;
+            rows_.push_back(row);
+        }
+        dwarf::dwarf_srclines_dealloc(dbg.get_handle(), lines, nlines);
+
+        // sequences are not necessarily emitted in address order; at equal
+        // addresses the end of a sequence sorts before the next one's start
+        std::stable_sort(rows_.begin(), rows_.end(), [](const Row& a, const Row& b) {
+            if (a.addr != b.addr)
+                return a.addr < b.addr;
+            return a.end_sequence > b.end_sequence;
+        });
+    }
+
+    size_t LineTable::find_index(Dwarf::Addr pc) const {
+        auto it = std::upper_bound(rows_.begin(), rows_.end(), pc,
+                [](Dwarf::Addr addr, const Row& r) { return addr < r.addr; });
+        if (it == rows_.begin())
+            return rows_.size();
+        --it;
+        if (it->end_sequence)
+            return rows_.size();
+        return static_cast<size_t>(it - rows_.begin());
+    }
+
+    const LineTable::Row* LineTable::find(Dwarf::Addr pc) const {
+        size_t i = find_index(pc);
+        return i < rows_.size() ? &rows_[i] : nullptr;
+    }
+
+    std::vector<LineInfo> Debug::lookup_lines(const std::vector<Dwarf::Addr>& addrs) const {
+        std::vector<LineInfo> out(addrs.size(), LineInfo{nullptr, 0, 0});
+
+        const AddressIndex& index = address_index();
+        const auto& units = index.units();
+
+        size_t seg = 0;
+        uint32_t cur_cu = static_cast<uint32_t>(-1);
+        const LineTable* table = nullptr;
+        size_t row = 0;
+        Dwarf::Addr prev = 0;
+
+        for (size_t i = 0; i < addrs.size(); ++i) {
+            Dwarf::Addr pc = addrs[i];
+
+            if (pc < prev) {
+                // not sorted after all, fall back to a fresh search
+                seg = 0;
+                cur_cu = static_cast<uint32_t>(-1);
+            }
+            prev = pc;
+
+            while (seg < units.size() && units[seg].hi <= pc)
+                ++seg;
+            if (seg == units.size() || pc < units[seg].lo)
+                continue;
+
+            uint32_t cu_index = index.entries()[units[seg].entry].cu;
+            if (cu_index != cur_cu) {
+                cur_cu = cu_index;
+                table = &cu(cu_index).line_table();
+                row = table->find_index(pc);
+            } else {
+                const auto& rows = table->rows();
+                if (row >= rows.size() || rows[row].addr > pc)
+                    row = table->find_index(pc);
+                while (row + 1 < rows.size() && rows[row + 1].addr <= pc)
+                    ++row;
+                if (row < rows.size() && rows[row].end_sequence)
+                    row = rows.size();
+            }
+
+            if (row < table->rows().size())
+                out[i] = table->info(table->rows()[row]);
+        }
+        return out;
+    }
+
+}
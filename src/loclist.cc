@@ -0,0 +1,208 @@
+/*
+ *  This file is part of libdwarf++.
+ *
+ *  Copyright © 2015 Frankin "Snaipe" Mathieu <http://snaipe.me>
+ *
+ *  libdwarf++ is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libdwarf++ is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libdwarf++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <algorithm>
+#include <exception>
+#include "libdwarf++/loclist.hh"
+#include "libdwarf++/dwarf.hh"
+#include "reader.hh"
+
+namespace Dwarf {
+
+    LocationList::LocationList(const Debug& dbg, dwarf::Dwarf_Attribute attr, const Unit& unit) {
+        Error err;
+        Dwarf::Half form;
+        if (dwarf::dwarf_whatform(attr, &form, &err) == DW_DLV_ERROR)
+            throw Exception(dbg.shared_from_this(), err);
+
+        if (form == DW_FORM_loclistx || (form == DW_FORM_sec_offset && unit.version >= 5)) {
+            Dwarf::Unsigned value = 0;
+            int res;
+            if (form == DW_FORM_sec_offset) {
+                Dwarf::Off offset = 0;
+                res = dwarf::dwarf_global_formref(attr, &offset, &err);
+                value = offset;
+            } else {
+                res = dwarf::dwarf_formudata(attr, &value, &err);
+            }
+            if (res == DW_DLV_ERROR)
+                throw Exception(dbg.shared_from_this(), err);
+            load_v5(dbg, value, form == DW_FORM_loclistx, unit);
+        } else {
+            load_v4(dbg, attr, unit.base);
+        }
+
+        std::stable_sort(entries_.begin(), entries_.end(), [](const Entry& a, const Entry& b) {
+            return a.lo < b.lo;
+        });
+        reach_.reserve(entries_.size());
+        for (const Entry& e : entries_)
+            reach_.push_back(reach_.empty() ? e.hi : std::max(reach_.back(), e.hi));
+    }
+
+    void LocationList::load_v4(const Debug& dbg, dwarf::Dwarf_Attribute attr, Dwarf::Addr base) {
+        Dwarf::Locdesc** descs;
+        Dwarf::Signed count;
+        Error err;
+        switch (dwarf::dwarf_loclist_n(attr, &descs, &count, &err)) {
+            case DW_DLV_ERROR: throw Exception(dbg.shared_from_this(), err);
+            case DW_DLV_NO_ENTRY: return;
+            default: break;
+        }
+
+        const Dwarf::Addr max_addr = dbg.address_size() < 8
+                ? (static_cast<Dwarf::Addr>(1) << (8 * dbg.address_size())) - 1
+                : ~static_cast<Dwarf::Addr>(0);
+
+        // everything libdwarf handed out has to be released, so a failure
+        // to compile one entry is only rethrown once the loop is done
+        std::exception_ptr failure;
+        entries_.reserve(static_cast<size_t>(count));
+        for (Dwarf::Signed i = 0; i < count; ++i) {
+            Dwarf::Locdesc* l = descs[i];
+            if (!failure) {
+                try {
+                    if (!l->ld_from_loclist) {
+                        entries_.push_back(Entry { 0, ~static_cast<Dwarf::Addr>(0), Expression(l->ld_s, l->ld_cents, dbg.address_size()) });
+                    } else if (l->ld_lopc == max_addr) {
+                        // base address selection entry
+                        base = l->ld_hipc;
+                    } else if (l->ld_lopc != l->ld_hipc) {
+                        entries_.push_back(Entry { base + l->ld_lopc, base + l->ld_hipc, Expression(l->ld_s, l->ld_cents, dbg.address_size()) });
+                    }
+                } catch (...) {
+                    failure = std::current_exception();
+                }
+            }
+            dbg.dealloc(l->ld_s);
+            dbg.dealloc(l);
+        }
+        dbg.dealloc(descs);
+
+        if (failure)
+            std::rethrow_exception(failure);
+    }
+
+    namespace {
+
+        Dwarf::Addr debug_addr(Span<const Dwarf::Small> addr, const LocationList::Unit& unit, uint64_t index) {
+            Reader r(addr);
+            r.seek(unit.addr_base);
+            if (!unit.address_size || index > addr.size() / unit.address_size)
+                throw std::runtime_error("Truncated DWARF data");
+            r.skip(index * unit.address_size);
+            return r.fixed(unit.address_size);
+        }
+
+    }
+
+    void LocationList::load_v5(const Debug& dbg, Dwarf::Off offset, bool indexed, const Unit& unit) {
+        Span<const Dwarf::Small> lists = dbg.raw_section(".debug_loclists");
+        if (lists.empty())
+            lists = dbg.raw_section(".debug_loclists.dwo");
+        if (lists.empty())
+            throw std::runtime_error("Location list without a readable .debug_loclists");
+        Span<const Dwarf::Small> addr = dbg.raw_section(".debug_addr");
+
+        Reader r(lists);
+        if (indexed) {
+            // DW_FORM_loclistx indexes the offset table at loclists_base
+            const size_t osz = unit.offset_size;
+            r.seek(unit.loclists_base);
+            if (offset > lists.size() / osz)
+                throw std::runtime_error("Truncated DWARF data");
+            r.skip(offset * osz);
+            offset = unit.loclists_base + r.fixed(osz);
+        }
+        r.seek(offset);
+
+        Dwarf::Addr base = unit.base;
+        const size_t asz = unit.address_size;
+        for (;;) {
+            Dwarf::Addr lo, hi;
+            switch (r.u8()) {
+                case DW_LLE_end_of_list:
+                    return;
+                case DW_LLE_base_addressx:
+                    base = debug_addr(addr, unit, r.uleb());
+                    continue;
+                case DW_LLE_base_address:
+                    base = r.fixed(asz);
+                    continue;
+                case DW_LLE_GNU_view_pair:
+                    // location views are not tracked
+                    r.uleb();
+                    r.uleb();
+                    continue;
+                case DW_LLE_default_location:
+                    default_ = std::make_shared<const Expression>(r.block(r.uleb()), unit.address_size, unit.offset_size);
+                    continue;
+                case DW_LLE_startx_endx:
+                    lo = debug_addr(addr, unit, r.uleb());
+                    hi = debug_addr(addr, unit, r.uleb());
+                    break;
+                case DW_LLE_startx_length:
+                    lo = debug_addr(addr, unit, r.uleb());
+                    hi = lo + r.uleb();
+                    break;
+                case DW_LLE_offset_pair:
+                    lo = base + r.uleb();
+                    hi = base + r.uleb();
+                    break;
+                case DW_LLE_start_end:
+                    lo = r.fixed(asz);
+                    hi = r.fixed(asz);
+                    break;
+                case DW_LLE_start_length:
+                    lo = r.fixed(asz);
+                    hi = lo + r.uleb();
+                    break;
+                default:
+                    throw std::runtime_error("Unknown location list entry");
+            }
+
+            Span<const Dwarf::Small> expr = r.block(r.uleb());
+            if (lo < hi)
+                entries_.push_back(Entry { lo, hi, Expression(expr, unit.address_size, unit.offset_size) });
+        }
+    }
+
+    const Expression* LocationList::find(Dwarf::Addr pc) const {
+        auto it = std::upper_bound(entries_.begin(), entries_.end(), pc, [](Dwarf::Addr pc, const Entry& e) {
+            return pc < e.lo;
+        });
+
+        // entries may overlap: walk back from the last one starting at or
+        // before pc for as long as some earlier entry still reaches past it
+        for (size_t i = it - entries_.begin(); i-- > 0 && reach_[i] > pc; )
+            if (pc < entries_[i].hi)
+                return &entries_[i].expr;
+        return default_.get();
+    }
+
+    Location LocationList::evaluate(Dwarf::Addr pc, const Expression::Context& ctx) const {
+        if (const Expression* expr = find(pc))
+            return expr->evaluate(ctx);
+
+        Location loc;
+        loc.pieces.push_back(Piece { Piece::UNDEFINED, 0, 0, 0 });
+        return loc;
+    }
+
+}
@@ -0,0 +1,222 @@
+/*
+ *  This file is part of libdwarf++.
+ *
+ *  Copyright © 2015 Frankin "Snaipe" Mathieu <http://snaipe.me>
+ *
+ *  libdwarf++ is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libdwarf++ is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libdwarf++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include "libdwarf++/nameindex.hh"
+#include "libdwarf++/cu.hh"
+#include "walk.hh"
+#include "parallel.hh"
+
+namespace Dwarf {
+
+    namespace {
+
+        struct RawName {
+            std::string name;
+            Dwarf::Off die;
+            Dwarf::Half tag;
+            uint16_t flags;
+        };
+
+        const char* linkage_name(const Debug& dbg, dwarf::Dwarf_Die die) {
+            Error err;
+            dwarf::Dwarf_Attribute attr;
+            for (Dwarf::Half at : { DW_AT_linkage_name, DW_AT_MIPS_linkage_name }) {
+                switch (dwarf::dwarf_attr(die, at, &attr, &err)) {
+                    case DW_DLV_NO_ENTRY: continue;
+                    case DW_DLV_ERROR: throw Exception(dbg.shared_from_this(), err);
+                    default: break;
+                }
+                char* str = nullptr;
+                int res = dwarf::dwarf_formstring(attr, &str, &err);
+                dbg.dealloc(attr);
+                if (res == DW_DLV_ERROR)
+                    throw Exception(dbg.shared_from_this(), err);
+                return str;
+            }
+            return nullptr;
+        }
+
+        bool is_declaration(const Debug& dbg, dwarf::Dwarf_Die die) {
+            Error err;
+            Dwarf::Bool has;
+            if (dwarf::dwarf_hasattr(die, DW_AT_declaration, &has, &err) == DW_DLV_ERROR)
+                throw Exception(dbg.shared_from_this(), err);
+            return has;
+        }
+
+        void collect_names(const Debug& dbg, dwarf::Dwarf_Die root, std::vector<RawName>& out) {
+            walk_dies(dbg, root, [&](dwarf::Dwarf_Die die, unsigned) {
+                Error err;
+                char* name = nullptr;
+                switch (dwarf::dwarf_diename(die, &name, &err)) {
+                    case DW_DLV_ERROR: throw Exception(dbg.shared_from_this(), err);
+                    default: break;
+                }
+                const char* linkage = linkage_name(dbg, die);
+
+                if (name || linkage) {
+                    Dwarf::Half tag;
+                    Dwarf::Off offset;
+                    if (dwarf::dwarf_tag(die, &tag, &err) == DW_DLV_ERROR
+                            || dwarf::dwarf_dieoffset(die, &offset, &err) == DW_DLV_ERROR) {
+                        if (name)
+                            dbg.dealloc(name);
+                        throw Exception(dbg.shared_from_this(), err);
+                    }
+                    uint16_t flags = is_declaration(dbg, die) ? NameIndex::DECLARATION : 0;
+
+                    if (name)
+                        out.push_back({name, offset, tag, flags});
+                    if (linkage && (!name || std::strcmp(name, linkage)))
+                        out.push_back({linkage, offset, tag,
+                                static_cast<uint16_t>(flags | NameIndex::LINKAGE_NAME)});
+                }
+                if (name)
+                    dbg.dealloc(name);
+                return Die::TraversalResult::TRAVERSE;
+            });
+        }
+
+    }
+
+    struct NameIndex::Tables {
+        std::vector<Entry> entries;
+        std::vector<uint32_t> buckets;
+        std::vector<char> pool;
+    };
+
+    NameIndex::NameIndex(const Debug& dbg, unsigned threads) {
+        auto tables = std::make_shared<Tables>();
+        std::vector<Entry>& entries = tables->entries;
+        std::vector<uint32_t>& buckets = tables->buckets;
+        std::vector<char>& pool = tables->pool;
+
+        std::vector<std::vector<RawName>> per_cu(dbg.cu_count());
+
+        // every unit is claimed by exactly one worker, so the slots need
+        // no locking and the result does not depend on scheduling
+        parallel_units(dbg, threads,
+            [&per_cu](const Debug& local, const CompilationUnit& cu, size_t index, unsigned) {
+                collect_names(local, cu.get_die().get_handle(), per_cu[index]);
+            });
+
+        std::unordered_map<std::string, uint32_t> interned;
+        for (uint32_t cu = 0; cu < per_cu.size(); ++cu) {
+            for (RawName& raw : per_cu[cu]) {
+                auto res = interned.emplace(raw.name, static_cast<uint32_t>(pool.size()));
+                if (res.second) {
+                    pool.insert(pool.end(), raw.name.begin(), raw.name.end());
+                    pool.push_back('\0');
+                }
+                entries.push_back({hash_name(raw.name.data(), raw.name.size()),
+                        res.first->second, cu, raw.die, raw.tag, raw.flags});
+            }
+            std::vector<RawName>().swap(per_cu[cu]);
+        }
+
+        size_t nbuckets = 1;
+        while (nbuckets < entries.size())
+            nbuckets <<= 1;
+        const uint64_t mask = nbuckets - 1;
+
+        std::stable_sort(entries.begin(), entries.end(), [mask](const Entry& a, const Entry& b) {
+            return (a.hash & mask) < (b.hash & mask);
+        });
+
+        buckets.assign(nbuckets + 1, 0);
+        for (const Entry& e : entries)
+            ++buckets[(e.hash & mask) + 1];
+        for (size_t b = 0; b < nbuckets; ++b)
+            buckets[b + 1] += buckets[b];
+
+        entries.shrink_to_fit();
+        pool.shrink_to_fit();
+
+        entries_ = Span<const Entry>(entries.data(), entries.size());
+        buckets_ = Span<const uint32_t>(buckets.data(), buckets.size());
+        pool_    = Span<const char>(pool.data(), pool.size());
+        owner_   = tables;
+    }
+
+    NameIndex::NameIndex(Span<const Entry> entries, Span<const uint32_t> buckets,
+                         Span<const char> pool, std::shared_ptr<const void> owner)
+        : entries_(entries)
+        , buckets_(buckets)
+        , pool_(pool)
+        , owner_(std::move(owner))
+    {}
+
+    bool NameIndex::valid(size_t cu_count) const {
+        // one more bound than there are buckets, which are a power of two
+        if (buckets_.size() < 2 || ((buckets_.size() - 1) & (buckets_.size() - 2)))
+            return false;
+        if (buckets_[0] != 0 || buckets_[buckets_.size() - 1] != entries_.size())
+            return false;
+        for (size_t b = 1; b < buckets_.size(); ++b)
+            if (buckets_[b] < buckets_[b - 1])
+                return false;
+
+        // a terminated pool keeps every name in it
+        if (!pool_.empty() && pool_[pool_.size() - 1] != '\0')
+            return false;
+        for (const Entry& e : entries_)
+            if (e.name >= pool_.size() || e.cu >= cu_count)
+                return false;
+        return true;
+    }
+
+    template <typename F>
+    void NameIndex::probe(const char* name, Dwarf::Half tag, F&& func) const {
+        if (entries_.empty())
+            return;
+
+        const uint64_t h = hash_name(name, std::strlen(name));
+        const size_t nbuckets = buckets_.size() - 1;
+        const size_t b = h & (nbuckets - 1);
+        for (uint32_t i = buckets_[b]; i < buckets_[b + 1]; ++i) {
+            const Entry& e = entries_[i];
+            if (e.hash != h || (tag && e.tag != tag) || std::strcmp(&pool_[e.name], name))
+                continue;
+            if (!func(e))
+                return;
+        }
+    }
+
+    const NameIndex::Entry* NameIndex::find_by_name(const char* name, Dwarf::Half tag) const {
+        const Entry* found = nullptr;
+        probe(name, tag, [&found](const Entry& e) {
+            found = &e;
+            return false;
+        });
+        return found;
+    }
+
+    std::vector<const NameIndex::Entry*> NameIndex::find_all(const char* name, Dwarf::Half tag) const {
+        std::vector<const Entry*> found;
+        probe(name, tag, [&found](const Entry& e) {
+            found.push_back(&e);
+            return true;
+        });
+        return found;
+    }
+
+}
@@ -0,0 +1,101 @@
+/*
+ *  This file is part of libdwarf++.
+ *
+ *  Copyright © 2015 Frankin "Snaipe" Mathieu <http://snaipe.me>
+ *
+ *  libdwarf++ is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libdwarf++ is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libdwarf++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LIBDWARFPP_PARALLEL_HH
+# define LIBDWARFPP_PARALLEL_HH
+
+# include <algorithm>
+# include <atomic>
+# include <exception>
+# include <mutex>
+# include <thread>
+# include <vector>
+# include "libdwarf++/dwarf.hh"
+# include "libdwarf++/cu.hh"
+
+namespace Dwarf {
+
+    inline unsigned worker_count(unsigned threads) {
+        if (threads)
+            return threads;
+        unsigned hw = std::thread::hardware_concurrency();
+        return hw ? hw : 1;
+    }
+
+    /*
+     * Runs func(worker_dbg, cu, cu_index, worker) over every unit of dbg on
+     * a pool of threads. libdwarf handles cannot be shared across threads,
+     * so each worker gets its own handle, and materializes the units it
+     * claims from a shared counter, using the header table of dbg. The
+     * handles are reopened from a first one made on the calling thread,
+     * so that they all share a single mapping of the object.
+     *
+     * The first exception thrown by a worker stops the others and is
+     * rethrown on the calling thread.
+     */
+    template <typename F>
+    void parallel_units(const Debug& dbg, unsigned threads, F&& func) {
+        const size_t count = dbg.cu_count();
+        threads = static_cast<unsigned>(std::min<size_t>(worker_count(threads), std::max<size_t>(count, 1)));
+
+        std::shared_ptr<const Debug> first = dbg.reopen();
+        if (!first)
+            throw DebugClosedException();
+
+        std::atomic<size_t> next(0);
+        std::atomic<bool> failed(false);
+        std::exception_ptr error;
+        std::mutex error_lock;
+
+        auto work = [&](unsigned worker) {
+            try {
+                std::shared_ptr<const Debug> local = worker ? first->reopen() : first;
+                if (!local)
+                    throw DebugClosedException();
+                for (size_t i = next++; i < count && !failed; i = next++) {
+                    const CUHeader& h = dbg.cu_header(i);
+                    std::shared_ptr<AnyDie> die = local->offdie(h.die_offset);
+                    if (!die)
+                        continue;
+                    CompilationUnit cu(local, die, h);
+                    func(*local, cu, i, worker);
+                }
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(error_lock);
+                if (!error)
+                    error = std::current_exception();
+                failed = true;
+            }
+        };
+
+        std::vector<std::thread> pool;
+        pool.reserve(threads - 1);
+        for (unsigned i = 1; i < threads; ++i)
+            pool.emplace_back(work, i);
+        work(0);
+        for (auto& t : pool)
+            t.join();
+
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+}
+
+#endif /* !LIBDWARFPP_PARALLEL_HH */
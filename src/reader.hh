@@ -0,0 +1,148 @@
+/*
+ *  This file is part of libdwarf++.
+ *
+ *  Copyright © 2015 Frankin "Snaipe" Mathieu <http://snaipe.me>
+ *
+ *  libdwarf++ is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libdwarf++ is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libdwarf++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LIBDWARFPP_READER_HH
+# define LIBDWARFPP_READER_HH
+
+# include <algorithm>
+# include <cstdint>
+# include <cstring>
+# include <stdexcept>
+# include "libdwarf++/cdwarf"
+# include "libdwarf++/span.hh"
+
+namespace Dwarf {
+
+    /*
+     * Cursor over raw section bytes (expressions, call frame instructions).
+     * Multi-byte values are read in host byte order, as the rest of the
+     * library assumes the target matches the host. Reading past the end
+     * throws.
+     */
+    class Reader {
+    public:
+        Reader(Span<const Dwarf::Small> bytes) : bytes_(bytes), pos_(0) {}
+
+        bool done() const       { return pos_ >= bytes_.size(); }
+        size_t offset() const   { return pos_; }
+
+        /* Pointer to the next unread byte. */
+        const Dwarf::Small* here() const {
+            return bytes_.data() + pos_;
+        }
+
+        Dwarf::Small u8() {
+            need(1);
+            return bytes_[pos_++];
+        }
+
+        uint64_t fixed(size_t size) {
+            need(size);
+            uint64_t v = 0;
+            std::memcpy(&v, bytes_.data() + pos_, size);
+            pos_ += size;
+            return v;
+        }
+
+        int64_t fixed_signed(size_t size) {
+            uint64_t v = fixed(size);
+            unsigned shift = 64 - 8 * size;
+            return static_cast<int64_t>(v << shift) >> shift;
+        }
+
+        uint64_t uleb() {
+            uint64_t v = 0;
+            unsigned shift = 0;
+            Dwarf::Small byte;
+            do {
+                need(1);
+                byte = bytes_[pos_++];
+                if (shift < 64)
+                    v |= static_cast<uint64_t>(byte & 0x7f) << shift;
+                shift += 7;
+            } while (byte & 0x80);
+            return v;
+        }
+
+        int64_t sleb() {
+            int64_t v = 0;
+            unsigned shift = 0;
+            Dwarf::Small byte;
+            do {
+                need(1);
+                byte = bytes_[pos_++];
+                if (shift < 64)
+                    v |= static_cast<int64_t>(byte & 0x7f) << shift;
+                shift += 7;
+            } while (byte & 0x80);
+            if (shift < 64 && (byte & 0x40))
+                v |= -(static_cast<int64_t>(1) << shift);
+            return v;
+        }
+
+        void skip(size_t size) {
+            need(size);
+            pos_ += size;
+        }
+
+        /* Skips a NUL-terminated string. */
+        void skip_cstring() {
+            const void* end = std::memchr(here(), 0, bytes_.size() - std::min(pos_, bytes_.size()));
+            if (!end)
+                throw std::runtime_error("Truncated DWARF data");
+            pos_ = static_cast<const Dwarf::Small*>(end) - bytes_.data() + 1;
+        }
+
+        void seek(size_t offset) {
+            if (offset > bytes_.size())
+                throw std::runtime_error("Truncated DWARF data");
+            pos_ = offset;
+        }
+
+        /* Skips size bytes and returns them. */
+        Span<const Dwarf::Small> block(size_t size) {
+            const Dwarf::Small* start = here();
+            skip(size);
+            return Span<const Dwarf::Small>(start, size);
+        }
+
+    private:
+        void need(size_t size) const {
+            // sizes may come straight from the data: pos_ + size could wrap
+            if (pos_ > bytes_.size() || size > bytes_.size() - pos_)
+                throw std::runtime_error("Truncated DWARF data");
+        }
+
+        Span<const Dwarf::Small> bytes_;
+        size_t pos_;
+    };
+
+    /* Offset size of the unit at offset in .debug_info, from its initial
+     * length: 8 in 64-bit DWARF, 4 otherwise or if it cannot be read. */
+    inline Dwarf::Half unit_offset_size(Span<const Dwarf::Small> info, Dwarf::Off offset) {
+        if (offset >= info.size() || info.size() - offset < 4)
+            return 4;
+        Reader r(info);
+        r.seek(offset);
+        return r.fixed(4) == 0xffffffff ? 8 : 4;
+    }
+
+}
+
+#endif /* !LIBDWARFPP_READER_HH */
@@ -0,0 +1,138 @@
+/*
+ *  This file is part of libdwarf++.
+ *
+ *  Copyright © 2015 Frankin "Snaipe" Mathieu <http://snaipe.me>
+ *
+ *  libdwarf++ is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libdwarf++ is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libdwarf++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <exception>
+#include <functional>
+#include <sys/stat.h>
+#include "libdwarf++/registry.hh"
+
+namespace Dwarf {
+
+    size_t Registry::KeyHash::operator()(const Key& k) const {
+        size_t h = std::hash<uint64_t>()(k.ino);
+        h ^= std::hash<uint64_t>()(k.dev) + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+        h ^= std::hash<int64_t>()(k.mtime_nsec) + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+        h ^= std::hash<int64_t>()(k.mtime_sec) + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+        return h;
+    }
+
+    Registry::Registry() {}
+
+    Registry::Registry(const Options& options)
+        : options_(options)
+    {}
+
+    Registry& Registry::global() {
+        static Registry registry;
+        return registry;
+    }
+
+    std::shared_ptr<const Debug> Registry::open(const char* path) {
+        struct stat st;
+        if (::stat(path, &st) == -1)
+            return nullptr;
+
+        const Key key = {
+            static_cast<uint64_t>(st.st_dev),
+            static_cast<uint64_t>(st.st_ino),
+            static_cast<int64_t>(st.st_mtim.tv_sec),
+            static_cast<int64_t>(st.st_mtim.tv_nsec),
+        };
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto found = by_file_.find(key);
+            if (found != by_file_.end()) {
+                lru_.splice(lru_.begin(), lru_, found->second);
+                return found->second->dbg;
+            }
+        }
+
+        // opening is slow, don't hold the lock meanwhile; a concurrent open
+        // of the same file may win the race, in which case its handle is
+        // used and this one dropped
+        std::shared_ptr<const Debug> dbg;
+        try {
+            dbg = options_.mapped
+                ? Debug::open_mapped(path, options_.map)
+                : Debug::open(path);
+        } catch (const std::exception&) {
+            return nullptr;
+        }
+        if (!dbg)
+            return nullptr;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto found = by_file_.find(key);
+        if (found != by_file_.end()) {
+            lru_.splice(lru_.begin(), lru_, found->second);
+            return found->second->dbg;
+        }
+
+        lru_.push_front(Entry { dbg, static_cast<size_t>(st.st_size), key });
+        by_file_.emplace(key, lru_.begin());
+        trim_locked();
+        return dbg;
+    }
+
+    void Registry::trim() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        trim_locked();
+    }
+
+    void Registry::trim_locked() {
+        size_t idle = 0;
+        size_t idle_bytes = 0;
+        for (const Entry& e : lru_) {
+            if (e.dbg.use_count() == 1) {
+                ++idle;
+                idle_bytes += e.size;
+            }
+        }
+
+        auto it = lru_.end();
+        while (it != lru_.begin()
+                && (idle > options_.max_idle
+                    || (options_.memory_budget && idle_bytes > options_.memory_budget))) {
+            --it;
+            if (it->dbg.use_count() != 1)
+                continue;
+            --idle;
+            idle_bytes -= it->size;
+            it = erase(it);
+        }
+    }
+
+    Registry::Lru::iterator Registry::erase(Lru::iterator it) {
+        by_file_.erase(it->key);
+        return lru_.erase(it);
+    }
+
+    void Registry::clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        by_file_.clear();
+        lru_.clear();
+    }
+
+    size_t Registry::size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return lru_.size();
+    }
+
+}
@@ -0,0 +1,353 @@
+/*
+ *  This file is part of libdwarf++.
+ *
+ *  Copyright © 2015 Frankin "Snaipe" Mathieu <http://snaipe.me>
+ *
+ *  libdwarf++ is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libdwarf++ is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libdwarf++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <cstring>
+#include <map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "skip.hh"
+#include "image.hh"
+#include "compress.hh"
+
+namespace Dwarf {
+
+    SubtreeSkipper::SubtreeSkipper(Span<const Dwarf::Small> info, Span<const Dwarf::Small> abbrev,
+                                   std::shared_ptr<const void> owner)
+        : info_(info)
+        , abbrev_(abbrev)
+        , owner_(std::move(owner))
+    {}
+
+    int64_t SubtreeSkipper::form_size(Dwarf::Half form, const Unit& unit) {
+        switch (form) {
+            case DW_FORM_flag_present:
+            case DW_FORM_implicit_const:
+                return 0;
+            case DW_FORM_data1:
+            case DW_FORM_ref1:
+            case DW_FORM_flag:
+            case DW_FORM_strx1:
+            case DW_FORM_addrx1:
+                return 1;
+            case DW_FORM_data2:
+            case DW_FORM_ref2:
+            case DW_FORM_strx2:
+            case DW_FORM_addrx2:
+                return 2;
+            case DW_FORM_strx3:
+            case DW_FORM_addrx3:
+                return 3;
+            case DW_FORM_data4:
+            case DW_FORM_ref4:
+            case DW_FORM_strx4:
+            case DW_FORM_addrx4:
+            case DW_FORM_ref_sup4:
+                return 4;
+            case DW_FORM_data8:
+            case DW_FORM_ref8:
+            case DW_FORM_ref_sig8:
+            case DW_FORM_ref_sup8:
+                return 8;
+            case DW_FORM_data16:
+                return 16;
+            case DW_FORM_addr:
+                return unit.address_size;
+            case DW_FORM_ref_addr:
+                return unit.version == 2 ? unit.address_size : unit.offset_size;
+            case DW_FORM_strp:
+            case DW_FORM_sec_offset:
+            case DW_FORM_line_strp:
+            case DW_FORM_strp_sup:
+            case DW_FORM_GNU_ref_alt:
+            case DW_FORM_GNU_strp_alt:
+                return unit.offset_size;
+            default:
+                return -1;
+        }
+    }
+
+    bool SubtreeSkipper::skip_form(Reader& r, Dwarf::Half form, const Unit& unit, uint64_t* value) const {
+        int64_t size = form_size(form, unit);
+        if (size >= 0) {
+            if (value && size <= 8)
+                *value = r.fixed(static_cast<size_t>(size));
+            else
+                r.skip(static_cast<size_t>(size));
+            return true;
+        }
+
+        switch (form) {
+            case DW_FORM_udata:
+            case DW_FORM_ref_udata:
+            case DW_FORM_strx:
+            case DW_FORM_addrx:
+            case DW_FORM_loclistx:
+            case DW_FORM_rnglistx:
+            case DW_FORM_GNU_addr_index:
+            case DW_FORM_GNU_str_index: {
+                uint64_t v = r.uleb();
+                if (value)
+                    *value = v;
+                return true;
+            }
+            case DW_FORM_sdata:
+                r.sleb();
+                return true;
+            case DW_FORM_string:
+                r.skip_cstring();
+                return true;
+            case DW_FORM_block1:
+                r.skip(r.u8());
+                return true;
+            case DW_FORM_block2:
+                r.skip(r.fixed(2));
+                return true;
+            case DW_FORM_block4:
+                r.skip(r.fixed(4));
+                return true;
+            case DW_FORM_block:
+            case DW_FORM_exprloc:
+                r.skip(r.uleb());
+                return true;
+            case DW_FORM_indirect:
+                return skip_form(r, static_cast<Dwarf::Half>(r.uleb()), unit, value);
+            default:
+                return false;
+        }
+    }
+
+    const std::vector<SubtreeSkipper::Abbrev>* SubtreeSkipper::abbrevs(uint64_t offset, const Unit& unit) const {
+        // fixed sizes depend on the unit, which abbreviation tables shared
+        // between units of different shapes must not mix up
+        const uint64_t key = offset
+                ^ (static_cast<uint64_t>(unit.version) << 40)
+                ^ (static_cast<uint64_t>(unit.address_size) << 48)
+                ^ (static_cast<uint64_t>(unit.offset_size) << 56);
+        auto found = tables_.find(key);
+        if (found != tables_.end())
+            return &found->second;
+
+        std::vector<Abbrev> table;
+        Reader r(abbrev_);
+        r.seek(offset);
+        for (;;) {
+            const uint64_t code = r.uleb();
+            if (!code)
+                break;
+            // producers number abbreviations densely; give up on anything else
+            if (code > (1u << 20))
+                return nullptr;
+            if (code >= table.size())
+                table.resize(code + 1);
+
+            Abbrev& a = table[code];
+            a.known = true;
+            r.uleb();               // tag
+            a.children = r.u8() == DW_CHILDREN_yes;
+            a.fixed = 0;
+            for (;;) {
+                const Dwarf::Half attr = static_cast<Dwarf::Half>(r.uleb());
+                const Dwarf::Half form = static_cast<Dwarf::Half>(r.uleb());
+                if (!attr && !form)
+                    break;
+                if (form == DW_FORM_implicit_const)
+                    r.sleb();
+                a.specs.push_back({ attr, form });
+                a.sibling = a.sibling || attr == DW_AT_sibling;
+
+                const int64_t size = form_size(form, unit);
+                a.fixed = a.fixed < 0 || size < 0 ? -1 : a.fixed + size;
+            }
+        }
+        return &tables_.emplace(key, std::move(table)).first->second;
+    }
+
+    bool SubtreeSkipper::next_sibling(const CUHeader& header, Dwarf::Off offset, Dwarf::Off& sibling) const {
+        if (header.end() > info_.size() || offset < header.offset || offset >= header.end())
+            return false;
+
+        try {
+            Reader r(info_.subspan(0, header.end()));
+            r.seek(header.offset);
+            Unit unit;
+            unit.offset_size = r.fixed(4) == 0xffffffffu ? 8 : 4;
+            unit.version = header.version;
+            unit.address_size = static_cast<uint8_t>(header.address_size);
+
+            const std::vector<Abbrev>* table = abbrevs(header.abbrev_offset, unit);
+            if (!table)
+                return false;
+
+            r.seek(offset);
+            unsigned depth = 0;
+            do {
+                const Dwarf::Off start = r.offset();
+                const uint64_t code = r.uleb();
+                if (!code) {
+                    if (!depth)
+                        return false;   // the starting DIE was a null entry
+                    --depth;
+                    continue;
+                }
+                if (code >= table->size() || !(*table)[code].known)
+                    return false;
+                const Abbrev& a = (*table)[code];
+
+                if (a.fixed >= 0 && !a.sibling) {
+                    r.skip(static_cast<size_t>(a.fixed));
+                    if (a.children)
+                        ++depth;
+                    continue;
+                }
+
+                uint64_t target = 0;
+                bool has_target = false;
+                for (const Spec& s : a.specs) {
+                    if (s.attr == DW_AT_sibling && a.children) {
+                        if (!skip_form(r, s.form, unit, &target))
+                            return false;
+                        has_target = s.form != DW_FORM_ref_addr && s.form != DW_FORM_ref_sig8
+                                && s.form != DW_FORM_ref_sup4 && s.form != DW_FORM_ref_sup8;
+                        target += has_target ? header.offset : 0;
+                    } else if (!skip_form(r, s.form, unit, nullptr)) {
+                        return false;
+                    }
+                }
+
+                // DW_AT_sibling jumps over the whole subtree, unless it
+                // points somewhere it could not possibly be; only forward
+                // jumps guarantee the walk ends
+                if (has_target && target > start && target <= header.end())
+                    r.seek(target);
+                else if (a.children)
+                    ++depth;
+            } while (depth);
+
+            sibling = r.offset() < header.end() && *r.here() ? r.offset() : 0;
+            return true;
+        } catch (const std::runtime_error&) {
+            return false;
+        }
+    }
+
+    namespace {
+
+        struct Mapping {
+            void* data = nullptr;
+            size_t size = 0;
+            std::unique_ptr<ElfImage> elf;
+            mutable std::map<std::string, CompressedSection> inflated;
+
+            ~Mapping() {
+                ::munmap(data, size);
+            }
+        };
+
+    }
+
+    Span<const Dwarf::Small> Debug::raw_section(const char* name) const {
+        if (image_) {
+            for (size_t i = 0; i < image_->section_count(); ++i)
+                if (std::strcmp(image_->section(i).name, name) == 0)
+                    return image_->section_data(i);
+            return Span<const Dwarf::Small>();
+        }
+
+        if (!raw_loaded_) {
+            raw_loaded_ = true;
+            // handles opened from a descriptor have no image: map the file
+            int fd = path_.empty() ? -1 : ::open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+            struct stat st;
+            if (fd != -1 && ::fstat(fd, &st) == 0 && st.st_size > 0) {
+                void* data = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (data != MAP_FAILED) {
+                    auto mapping = std::make_shared<Mapping>();
+                    mapping->data = data;
+                    mapping->size = static_cast<size_t>(st.st_size);
+                    try {
+                        mapping->elf.reset(new ElfImage(Span<const Dwarf::Small>(
+                                static_cast<const Dwarf::Small*>(data), mapping->size)));
+                        raw_map_ = mapping;
+                    } catch (const std::runtime_error&) {
+                    }
+                }
+            }
+            if (fd != -1)
+                ::close(fd);
+        }
+
+        if (!raw_map_)
+            return Span<const Dwarf::Small>();
+        const Mapping& mapping = *std::static_pointer_cast<const Mapping>(raw_map_);
+        const ElfImage& elf = *mapping.elf;
+        size_t i = elf.find(name);
+        if (i != elf.section_count() && !(elf.section(i).flags & SHF_COMPRESSED))
+            return elf.data(i);
+
+        // compressed sections, SHF_COMPRESSED or .zdebug_*, are inflated
+        // once on first use and kept with the mapping
+        auto found = mapping.inflated.find(name);
+        if (found != mapping.inflated.end())
+            return found->second.data;
+
+        CompressedSection& section = mapping.inflated[name];
+        for (size_t j = 0; j < elf.section_count(); ++j) {
+            CompressedSection c;
+            if (!find_compressed(elf, j, c) || c.name != name)
+                continue;
+            std::vector<CompressedSection*> one { &c };
+            try {
+                decompress(one, 1);
+                section = std::move(c);
+            } catch (const std::exception&) {
+            }
+            break;
+        }
+        return section.data;
+    }
+
+    bool Debug::next_sibling_offset(Dwarf::Off offset, Dwarf::Off& sibling) const {
+        if (!skipper_loaded_) {
+            skipper_loaded_ = true;
+
+            Span<const Dwarf::Small> info = raw_section(".debug_info");
+            Span<const Dwarf::Small> abbrev = raw_section(".debug_abbrev");
+            if (info.empty()) {
+                // package files index their abbreviations per unit
+                if (raw_section(".debug_cu_index").empty()) {
+                    info = raw_section(".debug_info.dwo");
+                    abbrev = raw_section(".debug_abbrev.dwo");
+                }
+            }
+
+            if (!info.empty() && !abbrev.empty())
+                skipper_ = std::make_shared<SubtreeSkipper>(info, abbrev, image_ ? image_ : raw_map_);
+        }
+
+        if (!skipper_)
+            return false;
+        const size_t cu = cu_index_for_offset(offset);
+        if (cu == cu_count())
+            return false;
+        return skipper_->next_sibling(cu_header(cu), offset, sibling);
+    }
+
+}
@@ -0,0 +1,84 @@
+/*
+ *  This file is part of libdwarf++.
+ *
+ *  Copyright © 2015 Frankin "Snaipe" Mathieu <http://snaipe.me>
+ *
+ *  libdwarf++ is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libdwarf++ is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libdwarf++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LIBDWARFPP_SKIP_HH
+# define LIBDWARFPP_SKIP_HH
+
+# include <cstdint>
+# include <memory>
+# include <unordered_map>
+# include <vector>
+# include "libdwarf++/dwarf.hh"
+# include "libdwarf++/cu.hh"
+# include "reader.hh"
+
+namespace Dwarf {
+
+    /*
+     * Finds the next sibling of a DIE straight from the .debug_info bytes.
+     * The skipped subtree is crossed through DW_AT_sibling when a DIE has
+     * one. Otherwise each DIE is stepped over using its abbreviation: most
+     * abbreviations only use fixed-size forms, and those DIEs are skipped
+     * in one step without looking at their attributes.
+     */
+    class SubtreeSkipper {
+    public:
+        SubtreeSkipper(Span<const Dwarf::Small> info, Span<const Dwarf::Small> abbrev,
+                       std::shared_ptr<const void> owner);
+
+        /*
+         * Sets sibling to the offset of the DIE following the subtree of
+         * the DIE at offset, or to 0 if it is the last of its siblings.
+         * Returns false for data it cannot decode, e.g. unknown forms.
+         */
+        bool next_sibling(const CUHeader& unit, Dwarf::Off offset, Dwarf::Off& sibling) const;
+
+    private:
+        struct Spec {
+            Dwarf::Half attr;
+            Dwarf::Half form;
+        };
+
+        struct Abbrev {
+            bool known = false;
+            bool children = false;
+            bool sibling = false;       // has DW_AT_sibling
+            int64_t fixed = -1;         // size of the attributes if constant
+            std::vector<Spec> specs;
+        };
+
+        struct Unit {
+            Dwarf::Half version;
+            uint8_t offset_size;
+            uint8_t address_size;
+        };
+
+        static int64_t form_size(Dwarf::Half form, const Unit& unit);
+        bool skip_form(Reader& r, Dwarf::Half form, const Unit& unit, uint64_t* value) const;
+        const std::vector<Abbrev>* abbrevs(uint64_t offset, const Unit& unit) const;
+
+        Span<const Dwarf::Small> info_;
+        Span<const Dwarf::Small> abbrev_;
+        std::shared_ptr<const void> owner_;
+        mutable std::unordered_map<uint64_t, std::vector<Abbrev>> tables_;
+    };
+
+}
+
+#endif /* !LIBDWARFPP_SKIP_HH */
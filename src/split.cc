@@ -0,0 +1,167 @@
+/*
+ *  This file is part of libdwarf++.
+ *
+ *  Copyright © 2015 Frankin "Snaipe" Mathieu <http://snaipe.me>
+ *
+ *  libdwarf++ is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libdwarf++ is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libdwarf++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <cstring>
+#include "libdwarf++/dwarf.hh"
+#include "libdwarf++/cu.hh"
+#include "reader.hh"
+
+namespace Dwarf {
+
+    static std::string dirname(const std::string& path) {
+        size_t slash = path.rfind('/');
+        return slash == std::string::npos ? std::string(".") : path.substr(0, slash);
+    }
+
+    std::shared_ptr<const Debug> Debug::open_split(const std::string& path) const {
+        std::shared_ptr<const Debug> dbg;
+        try {
+            dbg = image_ ? open_mapped(path.c_str()) : open(path.c_str());
+        } catch (NoDebugInformationException&) {
+            return nullptr;
+        }
+        if (!dbg)
+            return nullptr;
+
+        // lets libdwarf resolve address and string indices through the
+        // skeleton's sections; older producers do not need it
+        Error err;
+        dwarf::dwarf_set_tied_dbg(dbg->handle_, handle_, &err);
+        return dbg;
+    }
+
+    const CompilationUnit* Debug::split_unit(const char* dwo_name, const char* comp_dir, uint64_t dwo_id) const {
+        if (!dwp_loaded_) {
+            dwp_loaded_ = true;
+            if (!path_.empty())
+                dwp_ = open_split(path_ + ".dwp");
+        }
+
+        if (dwp_ && dwo_id) {
+            dwarf::Dwarf_Sig8 sig;
+            std::memcpy(sig.signature, &dwo_id, sizeof (sig.signature));
+
+            dwarf::Dwarf_Die die;
+            Error err;
+            switch (dwarf::dwarf_die_from_hash_signature(dwp_->handle_, &sig, "cu", &die, &err)) {
+                case DW_DLV_ERROR:
+                    // not found in the package: the .dwo files may still have it
+                    dwp_->dealloc(err);
+                    break;
+                case DW_DLV_OK: {
+                    Dwarf::Off offset;
+                    int res = dwarf::dwarf_dieoffset(die, &offset, &err);
+                    dwp_->dealloc(die);
+                    if (res == DW_DLV_ERROR)
+                        throw Exception(dwp_, err);
+
+                    size_t index = dwp_->cu_index_for_offset(offset);
+                    if (index < dwp_->cu_count())
+                        return &dwp_->cu(index);
+                } break;
+                default: break;
+            }
+        }
+
+        if (!dwo_name)
+            return nullptr;
+
+        std::vector<std::string> candidates;
+        if (dwo_name[0] == '/') {
+            candidates.push_back(dwo_name);
+        } else {
+            if (comp_dir)
+                candidates.push_back(std::string(comp_dir) + "/" + dwo_name);
+            if (!path_.empty())
+                candidates.push_back(dirname(path_) + "/" + dwo_name);
+            candidates.push_back(dwo_name);
+        }
+
+        for (const std::string& path : candidates) {
+            auto it = dwos_.find(path);
+            if (it == dwos_.end())
+                it = dwos_.emplace(path, open_split(path)).first;
+
+            const std::shared_ptr<const Debug>& dwo = it->second;
+            if (!dwo)
+                continue;
+
+            for (size_t i = 0; i < dwo->cu_count(); ++i) {
+                const CompilationUnit& cu = dwo->cu(i);
+                AttributeValue id = cu.get_die().get_value(DW_AT_GNU_dwo_id);
+                if (!id || id.as_unsigned() == dwo_id)
+                    return &cu;
+            }
+        }
+        return nullptr;
+    }
+
+    /* dwo_id of the DWARF 5 skeleton or split unit header at offset, or 0. */
+    static uint64_t header_dwo_id(const Debug& dbg, Dwarf::Off offset) {
+        try {
+            Reader r(dbg.raw_section(".debug_info"));
+            r.seek(offset);
+            size_t offset_size = 4;
+            if (r.fixed(4) == 0xffffffff) {
+                r.skip(8);
+                offset_size = 8;
+            }
+            if (r.fixed(2) < 5)
+                return 0;
+            const Dwarf::Small type = r.u8();
+            if (type != DW_UT_skeleton && type != DW_UT_split_compile)
+                return 0;
+            r.skip(1 + offset_size);    // address_size, debug_abbrev_offset
+            return r.fixed(8);
+        } catch (const std::runtime_error&) {
+            return 0;
+        }
+    }
+
+    const CompilationUnit* CompilationUnit::split_unit() const {
+        if (split_resolved_)
+            return split_;
+        split_resolved_ = true;
+
+        Die& die = get_die();
+        AttributeValue name = die.get_value(DW_AT_GNU_dwo_name);
+        if (!name)
+            name = die.get_value(DW_AT_dwo_name);
+        if (!name || name.kind() != AttributeValue::STRING)
+            return nullptr;
+
+        AttributeValue id = die.get_value(DW_AT_GNU_dwo_id);
+        AttributeValue dir = die.get_value(DW_AT_comp_dir);
+
+        std::shared_ptr<const Debug> dbg = dbg_.lock();
+        if (!dbg)
+            throw DebugClosedException();
+
+        // DWARF 5 moved the id from the attribute to the skeleton unit header
+        uint64_t dwo_id = id ? id.as_unsigned() : 0;
+        if (!id && version_stamp_ >= 5)
+            dwo_id = header_dwo_id(*dbg, header_ - header_len_);
+
+        split_ = dbg->split_unit(name.as_cstring(),
+                                 dir.kind() == AttributeValue::STRING ? dir.as_cstring() : nullptr,
+                                 dwo_id);
+        return split_;
+    }
+
+}
@@ -0,0 +1,467 @@
+/*
+ *  This file is part of libdwarf++.
+ *
+ *  Copyright © 2015 Frankin "Snaipe" Mathieu <http://snaipe.me>
+ *
+ *  libdwarf++ is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libdwarf++ is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libdwarf++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+#include "libdwarf++/typeindex.hh"
+#include "libdwarf++/attributes.hh"
+#include "libdwarf++/cu.hh"
+#include "libdwarf++/nameindex.hh"
+#include "walk.hh"
+#include "parallel.hh"
+
+namespace Dwarf {
+
+    namespace {
+
+        uint64_t mix(uint64_t h, uint64_t v) {
+            h ^= v + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+            return h;
+        }
+
+        uint64_t finish(uint64_t h) {
+            h ^= h >> 33;
+            h *= 0xff51afd7ed558ccdull;
+            h ^= h >> 33;
+            h *= 0xc4ceb9fe1a85ec53ull;
+            h ^= h >> 33;
+            return h;
+        }
+
+        // markers keeping the different kinds of hashed data apart
+        enum : uint64_t {
+            VOID = 1,
+            FOREIGN,
+            NOMINAL,
+            CYCLE,
+            DECLARATION,
+        };
+
+        bool is_type(Dwarf::Half tag) {
+            switch (tag) {
+                case DW_TAG_base_type:
+                case DW_TAG_unspecified_type:
+                case DW_TAG_pointer_type:
+                case DW_TAG_reference_type:
+                case DW_TAG_rvalue_reference_type:
+                case DW_TAG_ptr_to_member_type:
+                case DW_TAG_typedef:
+                case DW_TAG_const_type:
+                case DW_TAG_volatile_type:
+                case DW_TAG_restrict_type:
+                case DW_TAG_atomic_type:
+                case DW_TAG_immutable_type:
+                case DW_TAG_structure_type:
+                case DW_TAG_class_type:
+                case DW_TAG_union_type:
+                case DW_TAG_enumeration_type:
+                case DW_TAG_array_type:
+                case DW_TAG_subroutine_type:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        /* Types that declarations stand for, identified by qualified name. */
+        bool is_nominal(Dwarf::Half tag) {
+            return tag == DW_TAG_structure_type
+                || tag == DW_TAG_class_type
+                || tag == DW_TAG_union_type
+                || tag == DW_TAG_enumeration_type;
+        }
+
+        /* Children that are part of the structure of their parent type. */
+        bool is_part(Dwarf::Half tag) {
+            switch (tag) {
+                case DW_TAG_member:
+                case DW_TAG_inheritance:
+                case DW_TAG_enumerator:
+                case DW_TAG_subrange_type:
+                case DW_TAG_formal_parameter:
+                case DW_TAG_unspecified_parameters:
+                case DW_TAG_template_type_parameter:
+                case DW_TAG_template_value_parameter:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        bool is_scope(Dwarf::Half tag) {
+            return tag == DW_TAG_namespace || tag == DW_TAG_subprogram || is_nominal(tag);
+        }
+
+        uint64_t hash_value(const AttributeValue& v) {
+            switch (v.kind()) {
+                case AttributeValue::NONE:
+                    return 0;
+                case AttributeValue::STRING: {
+                    boost::string_view s = v.as_string();
+                    return hash_name(s.data(), s.size());
+                }
+                case AttributeValue::BLOCK:
+                case AttributeValue::EXPRLOC: {
+                    Span<const Dwarf::Small> b = v.kind() == AttributeValue::BLOCK ? v.as_block() : v.as_exprloc();
+                    return hash_name(reinterpret_cast<const char*>(b.data()), b.size());
+                }
+                case AttributeValue::FLAG:
+                    return v.as_flag();
+                case AttributeValue::ADDRESS:
+                    return v.as_address();
+                case AttributeValue::REFERENCE:
+                    return v.as_reference();
+                case AttributeValue::SECTION_OFFSET:
+                    return v.as_section_offset();
+                case AttributeValue::SIGNATURE:
+                    return v.as_signature();
+                case AttributeValue::INDEX:
+                    return v.as_index();
+                case AttributeValue::DATA16: {
+                    std::array<Dwarf::Small, 16> b = v.as_data16();
+                    return hash_name(reinterpret_cast<const char*>(b.data()), b.size());
+                }
+                case AttributeValue::UNSUPPORTED:
+                    return v.unsupported_form();
+                default:
+                    return v.as_unsigned();
+            }
+        }
+
+        /* Attributes that make up the shape of a type or of a part; names
+         * and references are handled separately. */
+        const Dwarf::Half structural[] = {
+            DW_AT_byte_size,
+            DW_AT_bit_size,
+            DW_AT_encoding,
+            DW_AT_data_member_location,
+            DW_AT_data_bit_offset,
+            DW_AT_bit_offset,
+            DW_AT_const_value,
+            DW_AT_count,
+            DW_AT_lower_bound,
+            DW_AT_upper_bound,
+            DW_AT_alignment,
+        };
+
+        uint64_t local_hash(Dwarf::Half tag, uint64_t name, const AttributeList& attrs) {
+            uint64_t h = mix(tag, name);
+            for (Dwarf::Half at : structural) {
+                if (const AttributeEntry* e = attrs.get(at))
+                    h = mix(mix(h, at), hash_value(e->value));
+            }
+            return h;
+        }
+
+        Dwarf::Off type_ref(const AttributeList& attrs) {
+            const AttributeEntry* e = attrs.get(DW_AT_type);
+            return e && e->value.kind() == AttributeValue::REFERENCE ? e->value.as_reference() : 0;
+        }
+
+        struct Part {
+            uint64_t local;
+            Dwarf::Off type;
+        };
+
+        struct Node {
+            Dwarf::Off die;
+            Dwarf::Half tag;
+            bool declaration;
+            uint64_t name;
+            uint64_t key;           // tag, scope and name
+            uint64_t local;
+            Dwarf::Off type;
+            std::vector<Part> parts;
+        };
+
+        struct RawType {
+            Dwarf::Off die;
+            uint64_t hash;
+            uint64_t key;
+            Dwarf::Half tag;
+            bool declaration;
+            bool nominal;
+        };
+
+        struct MergeKey {
+            uint64_t hash;
+            uint64_t key;
+            Dwarf::Half tag;
+
+            bool operator==(const MergeKey& other) const {
+                return hash == other.hash && key == other.key && tag == other.tag;
+            }
+
+            struct Hash {
+                size_t operator()(const MergeKey& k) const {
+                    return static_cast<size_t>(k.hash);
+                }
+            };
+        };
+
+        class UnitHasher {
+        public:
+            explicit UnitHasher(std::vector<Node>& nodes) : nodes_(nodes) {
+                for (size_t i = 0; i < nodes_.size(); ++i)
+                    at_.emplace(nodes_[i].die, i);
+                hashes_.assign(nodes_.size(), 0);
+                state_.assign(nodes_.size(), NEW);
+            }
+
+            uint64_t hash(size_t i) {
+                if (state_[i] == DONE)
+                    return hashes_[i];
+                if (state_[i] == BUSY) {
+                    // a cycle can only be closed through a name
+                    const Node& n = nodes_[i];
+                    if (is_nominal(n.tag) && n.name)
+                        return mix(NOMINAL, n.key);
+                    return mix(CYCLE, n.tag);
+                }
+
+                state_[i] = BUSY;
+                const Node& n = nodes_[i];
+                uint64_t h = mix(n.key, n.local);
+                if (n.declaration)
+                    h = mix(h, DECLARATION);
+                h = mix(h, reference(n.type));
+                for (const Part& p : n.parts)
+                    h = mix(mix(h, p.local), reference(p.type));
+                hashes_[i] = finish(h);
+                state_[i] = DONE;
+                return hashes_[i];
+            }
+
+        private:
+            enum State : uint8_t { NEW, BUSY, DONE };
+
+            uint64_t reference(Dwarf::Off off) {
+                if (!off)
+                    return VOID;
+                auto found = at_.find(off);
+                if (found == at_.end())
+                    return mix(FOREIGN, off);
+                // names are not unique across units (file-scope C structs),
+                // so referenced types count with their whole structure
+                return hash(found->second);
+            }
+
+            std::vector<Node>& nodes_;
+            std::unordered_map<Dwarf::Off, size_t> at_;
+            std::vector<uint64_t> hashes_;
+            std::vector<State> state_;
+        };
+
+        void collect_types(const Debug& dbg, dwarf::Dwarf_Die root, std::vector<RawType>& out) {
+            std::vector<Node> nodes;
+            std::vector<uint64_t> scopes;       // by depth
+            std::vector<size_t> owners;         // node of the DIE at each depth, or npos
+            const size_t npos = static_cast<size_t>(-1);
+
+            walk_dies(dbg, root, [&](dwarf::Dwarf_Die die, unsigned depth) {
+                Error err;
+                Dwarf::Half tag;
+                if (dwarf::dwarf_tag(die, &tag, &err) == DW_DLV_ERROR)
+                    throw Exception(dbg.shared_from_this(), err);
+
+                scopes.resize(depth + 1);
+                owners.resize(depth + 1);
+                const uint64_t scope = depth ? scopes[depth - 1] : 0;
+                const size_t owner = depth ? owners[depth - 1] : npos;
+                scopes[depth] = scope;
+                owners[depth] = npos;
+
+                const bool type = is_type(tag);
+                const bool part = owner != npos && is_part(tag);
+                if (!type && !part && !is_scope(tag))
+                    return Die::TraversalResult::TRAVERSE;
+
+                AttributeList attrs;
+                attrs.load(dbg, die);
+                const AttributeEntry* name_attr = attrs.get(DW_AT_name);
+                const uint64_t name = name_attr ? hash_value(name_attr->value) : 0;
+
+                if (is_scope(tag) && name)
+                    scopes[depth] = mix(mix(scope, tag), name);
+
+                if (part) {
+                    nodes[owner].parts.push_back({ local_hash(tag, name, attrs), type_ref(attrs) });
+                } else if (type) {
+                    Node n;
+                    if (dwarf::dwarf_dieoffset(die, &n.die, &err) == DW_DLV_ERROR)
+                        throw Exception(dbg.shared_from_this(), err);
+                    n.tag = tag;
+                    n.declaration = attrs.has(DW_AT_declaration);
+                    n.name = name;
+                    n.key = mix(mix(scope, tag), name);
+                    n.local = local_hash(tag, name, attrs);
+                    n.type = type_ref(attrs);
+                    owners[depth] = nodes.size();
+                    nodes.push_back(std::move(n));
+                }
+                return Die::TraversalResult::TRAVERSE;
+            });
+
+            UnitHasher hasher(nodes);
+            out.reserve(nodes.size());
+            for (size_t i = 0; i < nodes.size(); ++i) {
+                const Node& n = nodes[i];
+                out.push_back({ n.die, hasher.hash(i), n.key, n.tag, n.declaration,
+                        is_nominal(n.tag) && n.name != 0 });
+            }
+        }
+
+    }
+
+    struct TypeIndex::Tables {
+        std::vector<Entry> entries;
+        std::vector<Alias> aliases;
+    };
+
+    TypeIndex::TypeIndex(const Debug& dbg, unsigned threads) {
+        auto tables = std::make_shared<Tables>();
+        std::vector<Entry>& entries = tables->entries;
+        std::vector<Alias>& aliases = tables->aliases;
+
+        std::vector<std::vector<RawType>> per_cu(dbg.cu_count());
+        parallel_units(dbg, threads,
+            [&per_cu](const Debug& local, const CompilationUnit& cu, size_t index, unsigned) {
+                collect_types(local, cu.get_die().get_handle(), per_cu[index]);
+            });
+
+        // Merged in unit order, so entries do not depend on scheduling.
+        // Types merge on their 64-bit hash; the tag and the scoped name
+        // that went into it are compared as well, so a collision between
+        // different names or kinds of types is kept apart. Two same-named
+        // types whose members collide still merge, at a 2^-64 chance.
+        std::unordered_map<MergeKey, uint32_t, MergeKey::Hash> by_hash;
+        std::unordered_map<uint64_t, uint32_t> definitions;     // by scoped name
+        const uint32_t ambiguous = static_cast<uint32_t>(-1);
+        auto add = [&](const RawType& t, uint32_t cu, uint32_t entry) {
+            if (entry == entries.size())
+                entries.push_back({ t.hash, t.die, cu, 0, t.tag });
+            ++entries[entry].count;
+            aliases.push_back({ t.die, entry });
+        };
+
+        for (uint32_t cu = 0; cu < per_cu.size(); ++cu) {
+            for (const RawType& t : per_cu[cu]) {
+                if (t.declaration && t.nominal)
+                    continue;
+                uint32_t entry = by_hash.emplace(MergeKey { t.hash, t.key, t.tag },
+                                                 static_cast<uint32_t>(entries.size())).first->second;
+                add(t, cu, entry);
+                if (t.nominal) {
+                    auto def = definitions.emplace(t.key, entry).first;
+                    if (def->second != entry)
+                        def->second = ambiguous;
+                }
+            }
+        }
+        for (uint32_t cu = 0; cu < per_cu.size(); ++cu) {
+            for (const RawType& t : per_cu[cu]) {
+                if (!t.declaration || !t.nominal)
+                    continue;
+                // declarations only join a definition when their name
+                // has a single one
+                auto def = definitions.find(t.key);
+                uint32_t entry = def != definitions.end() && def->second != ambiguous
+                        ? def->second
+                        : by_hash.emplace(MergeKey { t.hash, t.key, t.tag },
+                                          static_cast<uint32_t>(entries.size())).first->second;
+                add(t, cu, entry);
+            }
+            std::vector<RawType>().swap(per_cu[cu]);
+        }
+
+        std::vector<uint32_t> order(entries.size());
+        for (uint32_t i = 0; i < order.size(); ++i)
+            order[i] = i;
+        std::sort(order.begin(), order.end(), [&entries](uint32_t a, uint32_t b) {
+            return entries[a].hash < entries[b].hash;
+        });
+        std::vector<uint32_t> rank(entries.size());
+        std::vector<Entry> sorted;
+        sorted.reserve(entries.size());
+        for (uint32_t i = 0; i < order.size(); ++i) {
+            rank[order[i]] = i;
+            sorted.push_back(entries[order[i]]);
+        }
+        entries.swap(sorted);
+
+        for (Alias& a : aliases)
+            a.entry = rank[a.entry];
+        std::sort(aliases.begin(), aliases.end(), [](const Alias& a, const Alias& b) {
+            return a.die < b.die;
+        });
+        aliases.shrink_to_fit();
+
+        entries_ = Span<const Entry>(entries.data(), entries.size());
+        aliases_ = Span<const Alias>(aliases.data(), aliases.size());
+        owner_   = tables;
+    }
+
+    TypeIndex::TypeIndex(Span<const Entry> entries, Span<const Alias> aliases, std::shared_ptr<const void> owner)
+        : entries_(entries)
+        , aliases_(aliases)
+        , owner_(std::move(owner))
+    {}
+
+    bool TypeIndex::valid(size_t cu_count) const {
+        for (size_t i = 0; i < entries_.size(); ++i) {
+            if (entries_[i].cu >= cu_count)
+                return false;
+            if (i && entries_[i - 1].hash > entries_[i].hash)
+                return false;
+        }
+        for (size_t i = 0; i < aliases_.size(); ++i) {
+            if (aliases_[i].entry >= entries_.size())
+                return false;
+            if (i && aliases_[i - 1].die >= aliases_[i].die)
+                return false;
+        }
+        return true;
+    }
+
+    const TypeIndex::Entry* TypeIndex::find(Dwarf::Off die) const {
+        auto it = std::lower_bound(aliases_.begin(), aliases_.end(), die,
+                [](const Alias& a, Dwarf::Off off) { return a.die < off; });
+        if (it == aliases_.end() || it->die != die)
+            return nullptr;
+        return &entries_[it->entry];
+    }
+
+    const TypeIndex::Entry* TypeIndex::find_hash(uint64_t hash) const {
+        auto it = std::lower_bound(entries_.begin(), entries_.end(), hash,
+                [](const Entry& e, uint64_t h) { return e.hash < h; });
+        if (it == entries_.end() || it->hash != hash)
+            return nullptr;
+        return &*it;
+    }
+
+    const TypeIndex& Debug::type_index() const {
+        if (!type_index_) {
+            type_index_ = std::make_shared<TypeIndex>(*this);
+            save_index();
+        }
+        return *type_index_;
+    }
+
+}
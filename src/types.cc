@@ -0,0 +1,318 @@
+/*
+ *  This file is part of libdwarf++.
+ *
+ *  Copyright © 2015 Frankin "Snaipe" Mathieu <http://snaipe.me>
+ *
+ *  libdwarf++ is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libdwarf++ is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libdwarf++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <algorithm>
+#include "libdwarf++/types.hh"
+#include "libdwarf++/die.hh"
+#include "reader.hh"
+
+namespace Dwarf {
+
+    namespace {
+
+        Die& as_die(AnyDie& any) {
+            Die::visitor_to_die v;
+            return any.apply_visitor(v);
+        }
+
+        uint64_t udata(const Die& die, Dwarf::Half attr, uint64_t def = 0) {
+            AttributeValue v = die.get_value(attr);
+            if (v.kind() == AttributeValue::UNSIGNED || v.kind() == AttributeValue::SIGNED)
+                return v.as_unsigned();
+            return def;
+        }
+
+        Dwarf::Off reference(const Die& die, Dwarf::Half attr) {
+            AttributeValue v = die.get_value(attr);
+            return v.kind() == AttributeValue::REFERENCE ? v.as_reference() : 0;
+        }
+
+        /* DW_AT_data_member_location is a constant, or before DWARF 4 a
+         * DW_OP_plus_uconst expression applied to the object address. */
+        uint64_t member_location(const Die& die) {
+            AttributeValue v = die.get_value(DW_AT_data_member_location);
+            switch (v.kind()) {
+                case AttributeValue::UNSIGNED:
+                case AttributeValue::SIGNED:
+                    return v.as_unsigned();
+                case AttributeValue::BLOCK:
+                case AttributeValue::EXPRLOC: {
+                    Reader r(v.kind() == AttributeValue::BLOCK ? v.as_block() : v.as_exprloc());
+                    if (!r.done() && r.u8() == DW_OP_plus_uconst)
+                        return r.uleb();
+                    return 0;
+                }
+                default:
+                    return 0;
+            }
+        }
+
+        bool is_alias(Dwarf::Half tag) {
+            switch (tag) {
+                case DW_TAG_typedef:
+                case DW_TAG_const_type:
+                case DW_TAG_volatile_type:
+                case DW_TAG_restrict_type:
+                case DW_TAG_atomic_type:
+                case DW_TAG_immutable_type:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        bool is_aggregate(Dwarf::Half tag) {
+            return tag == DW_TAG_structure_type
+                || tag == DW_TAG_class_type
+                || tag == DW_TAG_union_type;
+        }
+
+        uint64_t natural_alignment(uint64_t size) {
+            uint64_t a = 1;
+            while (a < 16 && a * 2 <= size)
+                a *= 2;
+            return a;
+        }
+
+    }
+
+    TypeResolver::TypeResolver(const Debug& dbg)
+        : dbg_(dbg.shared_from_this())
+        , address_size_(dbg.address_size())
+    {}
+
+    Dwarf::Off TypeResolver::canonical(Dwarf::Off type) const {
+        if (!type)
+            return 0;
+        auto found = canonical_.find(type);
+        if (found != canonical_.end())
+            return found->second;
+
+        std::shared_ptr<const Debug> dbg = dbg_.lock();
+        if (!dbg)
+            throw DebugClosedException();
+
+        // the bound only matters for malformed, cyclic chains
+        std::vector<Dwarf::Off> chain;
+        Dwarf::Off cur = type;
+        while (cur && chain.size() < 64) {
+            auto known = canonical_.find(cur);
+            if (known != canonical_.end()) {
+                cur = known->second;
+                break;
+            }
+
+            std::shared_ptr<AnyDie> any = dbg->offdie(cur);
+            Die& die = as_die(*any);
+            if (!is_alias(Die::get_tag_id(dbg, die.get_handle())))
+                break;
+            chain.push_back(cur);
+            cur = reference(die, DW_AT_type);
+        }
+
+        for (Dwarf::Off off : chain)
+            canonical_[off] = cur;
+        canonical_[type] = cur;
+        return cur;
+    }
+
+    const TypeResolver::Type* TypeResolver::resolve(Dwarf::Off off) const {
+        off = canonical(off);
+        if (!off)
+            return nullptr;
+        auto found = types_.find(off);
+        if (found != types_.end())
+            return &found->second;
+
+        std::shared_ptr<const Debug> dbg = dbg_.lock();
+        if (!dbg)
+            throw DebugClosedException();
+        std::shared_ptr<AnyDie> any = dbg->offdie(off);
+        Die& die = as_die(*any);
+
+        // inserted before its members are resolved; references into the
+        // map stay valid as it grows
+        Type& type = types_[off];
+        type.die = off;
+        type.tag = Die::get_tag_id(dbg, die.get_handle());
+        AttributeValue name = die.get_value(DW_AT_name);
+        type.name = name.kind() == AttributeValue::STRING ? name.as_cstring() : nullptr;
+        type.size = udata(die, DW_AT_byte_size);
+        type.alignment = udata(die, DW_AT_alignment);
+
+        switch (type.tag) {
+            case DW_TAG_pointer_type:
+            case DW_TAG_reference_type:
+            case DW_TAG_rvalue_reference_type:
+            case DW_TAG_ptr_to_member_type:
+                if (!type.size)
+                    type.size = address_size_;
+                type.target = canonical(reference(die, DW_AT_type));
+                break;
+
+            case DW_TAG_array_type: {
+                type.target = canonical(reference(die, DW_AT_type));
+                type.count = 1;
+                for (Die& sub : die.children()) {
+                    if (Die::get_tag_id(dbg, sub.get_handle()) != DW_TAG_subrange_type)
+                        continue;
+                    uint64_t n = udata(sub, DW_AT_count);
+                    if (!n && sub.get_value(DW_AT_upper_bound))
+                        n = udata(sub, DW_AT_upper_bound) - udata(sub, DW_AT_lower_bound) + 1;
+                    type.count *= n;
+                }
+                const Type* elem = resolve(type.target);
+                if (elem) {
+                    if (!type.size)
+                        type.size = elem->size * type.count;
+                    if (!type.alignment)
+                        type.alignment = elem->alignment;
+                }
+                break;
+            }
+
+            case DW_TAG_enumeration_type:
+                if (!type.size) {
+                    const Type* underlying = resolve(reference(die, DW_AT_type));
+                    type.size = underlying ? underlying->size : 0;
+                }
+                break;
+
+            case DW_TAG_structure_type:
+            case DW_TAG_class_type:
+            case DW_TAG_union_type:
+                layout(type, die);
+                break;
+
+            default:
+                break;
+        }
+
+        if (!type.alignment)
+            type.alignment = is_aggregate(type.tag) ? 1 : natural_alignment(type.size);
+        return &type;
+    }
+
+    const TypeResolver::Type* TypeResolver::type_of(Dwarf::Off off) const {
+        std::shared_ptr<const Debug> dbg = dbg_.lock();
+        if (!dbg)
+            throw DebugClosedException();
+        std::shared_ptr<AnyDie> any = dbg->offdie(off);
+        return resolve(reference(as_die(*any), DW_AT_type));
+    }
+
+    void TypeResolver::layout(Type& type, Die& die) const {
+        std::shared_ptr<const Debug> dbg = dbg_.lock();
+        for (Die& child : die.children()) {
+            Dwarf::Half tag = Die::get_tag_id(dbg, child.get_handle());
+            if (tag != DW_TAG_member && tag != DW_TAG_inheritance)
+                continue;
+            // static data members are declarations
+            if (child.get_value(DW_AT_declaration))
+                continue;
+            add_member(type, child, tag == DW_TAG_inheritance);
+        }
+
+        std::stable_sort(type.fields.begin(), type.fields.end(),
+                [](const Field& a, const Field& b) {
+                    return a.offset < b.offset || (a.offset == b.offset && a.bit_offset < b.bit_offset);
+                });
+
+        type.reach.reserve(type.fields.size());
+        for (const Field& f : type.fields) {
+            const uint64_t end = f.offset + std::max<uint64_t>(f.size, 1);
+            type.reach.push_back(type.reach.empty() ? end : std::max(type.reach.back(), end));
+        }
+    }
+
+    void TypeResolver::add_member(Type& type, Die& member, bool inheritance) const {
+        const Type* mt = resolve(reference(member, DW_AT_type));
+        uint64_t offset = type.tag == DW_TAG_union_type ? 0 : member_location(member);
+        AttributeValue name = member.get_value(DW_AT_name);
+        const char* mname = name.kind() == AttributeValue::STRING ? name.as_cstring() : nullptr;
+
+        if (mt)
+            type.alignment = std::max(type.alignment, mt->alignment);
+
+        Field f;
+        f.die = member.get_offset();
+        f.type = mt ? mt->die : 0;
+        f.path = mname ? mname : "";
+        f.offset = offset;
+        f.size = mt ? mt->size : 0;
+        f.bit_offset = 0;
+        f.bit_size = 0;
+
+        const uint64_t bit_size = udata(member, DW_AT_bit_size);
+        if (bit_size) {
+            uint64_t bits = offset * 8;
+            if (member.get_value(DW_AT_data_bit_offset)) {
+                bits = udata(member, DW_AT_data_bit_offset);
+            } else if (member.get_value(DW_AT_bit_offset)) {
+                // DWARF 2/3 count from the most significant bit of the
+                // storage unit; the target is assumed little-endian
+                const uint64_t storage = udata(member, DW_AT_byte_size, f.size);
+                bits += storage * 8 - udata(member, DW_AT_bit_offset) - bit_size;
+            }
+            f.offset = bits / 8;
+            f.bit_offset = static_cast<uint16_t>(bits % 8);
+            f.bit_size = static_cast<uint16_t>(bit_size);
+            f.size = (f.bit_offset + bit_size + 7) / 8;
+            type.fields.push_back(std::move(f));
+            return;
+        }
+
+        if (!mt || !is_aggregate(mt->tag) || mt->fields.empty()) {
+            type.fields.push_back(std::move(f));
+            return;
+        }
+
+        // inline the members of nested aggregates; base classes and
+        // anonymous members add nothing to the path
+        const std::string prefix = inheritance || !mname ? "" : std::string(mname) + ".";
+        for (const Field& inner : mt->fields) {
+            Field g = inner;
+            g.offset += offset;
+            g.path = prefix + inner.path;
+            type.fields.push_back(std::move(g));
+        }
+    }
+
+    const TypeResolver::Field* TypeResolver::field_at(const Type& type, uint64_t offset) const {
+        auto it = std::upper_bound(type.fields.begin(), type.fields.end(), offset,
+                [](uint64_t off, const Field& f) { return off < f.offset; });
+
+        // only union members overlap: past the fields that can still reach
+        // offset, as reach tells, there is nothing left to find. Without
+        // unions that is the predecessor alone, padding included
+        for (size_t i = it - type.fields.begin(); i-- > 0 && type.reach[i] > offset; ) {
+            const Field& f = type.fields[i];
+            if (offset < f.offset + std::max<uint64_t>(f.size, 1))
+                return &f;
+        }
+        return nullptr;
+    }
+
+    const TypeResolver& Debug::types() const {
+        if (!types_)
+            types_ = std::make_shared<TypeResolver>(*this);
+        return *types_;
+    }
+
+}
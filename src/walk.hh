@@ -0,0 +1,132 @@
+/*
+ *  This file is part of libdwarf++.
+ *
+ *  Copyright © 2015 Frankin "Snaipe" Mathieu <http://snaipe.me>
+ *
+ *  libdwarf++ is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libdwarf++ is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libdwarf++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LIBDWARFPP_WALK_HH
+# define LIBDWARFPP_WALK_HH
+
+# include <vector>
+# include "libdwarf++/dwarf.hh"
+# include "libdwarf++/die.hh"
+
+namespace Dwarf {
+
+    inline dwarf::Dwarf_Die raw_child(const Debug& dbg, dwarf::Dwarf_Die die) {
+        Error err;
+        dwarf::Dwarf_Die child = nullptr;
+        switch (dwarf::dwarf_child(die, &child, &err)) {
+            case DW_DLV_NO_ENTRY: return nullptr;
+            case DW_DLV_ERROR: throw Exception(dbg.shared_from_this(), err);
+            default: return child;
+        }
+    }
+
+    inline dwarf::Dwarf_Die raw_offdie(const Debug& dbg, Dwarf::Off offset) {
+        Error err;
+        dwarf::Dwarf_Die die = nullptr;
+        switch (dwarf::dwarf_offdie(dbg.get_handle(), offset, &die, &err)) {
+            case DW_DLV_NO_ENTRY: return nullptr;
+            case DW_DLV_ERROR: throw Exception(dbg.shared_from_this(), err);
+            default: return die;
+        }
+    }
+
+    /* Sibling of die; unless it is a leaf, its subtree is skipped without
+     * being decoded when possible. */
+    inline dwarf::Dwarf_Die raw_sibling(const Debug& dbg, dwarf::Dwarf_Die die, bool leaf = false) {
+        Error err;
+        Dwarf::Off offset, next;
+        if (!leaf && dwarf::dwarf_dieoffset(die, &offset, &err) == DW_DLV_OK
+                && dbg.next_sibling_offset(offset, next))
+            return next ? raw_offdie(dbg, next) : nullptr;
+
+        dwarf::Dwarf_Die sibling = nullptr;
+        switch (dwarf::dwarf_siblingof(dbg.get_handle(), die, &sibling, &err)) {
+            case DW_DLV_NO_ENTRY: return nullptr;
+            case DW_DLV_ERROR: throw Exception(dbg.shared_from_this(), err);
+            default: return sibling;
+        }
+    }
+
+    /*
+     * Preorder walk over the raw libdwarf DIEs below (and including) root,
+     * without materializing any Die object. func(die, depth) is called for
+     * every DIE and returns a Die::TraversalResult; depth is 0 for root.
+     *
+     * Only the chain of open ancestors is kept alive, so the native stack
+     * stays constant and memory grows with the tree depth. Every DIE except
+     * root is deallocated by the walker.
+     */
+    template <typename F>
+    void walk_dies(const Debug& dbg, dwarf::Dwarf_Die root, F&& func) {
+        switch (func(root, 0u)) {
+            case Die::TraversalResult::SKIP:
+            case Die::TraversalResult::BREAK:
+                return;
+            default: break;
+        }
+
+        std::vector<dwarf::Dwarf_Die> parents;
+        dwarf::Dwarf_Die cur = raw_child(dbg, root);
+
+        try {
+            while (cur || !parents.empty()) {
+                if (!cur) {
+                    dwarf::Dwarf_Die parent = parents.back();
+                    cur = raw_sibling(dbg, parent);
+                    parents.pop_back();
+                    dbg.dealloc(parent);
+                    continue;
+                }
+
+                dwarf::Dwarf_Die child = nullptr;
+                bool skipped = false;
+                switch (func(cur, static_cast<unsigned>(parents.size() + 1))) {
+                    case Die::TraversalResult::BREAK:
+                        dbg.dealloc(cur);
+                        for (auto& d : parents)
+                            dbg.dealloc(d);
+                        return;
+                    case Die::TraversalResult::SKIP:
+                        skipped = true;
+                        break;
+                    default:
+                        child = raw_child(dbg, cur);
+                }
+
+                if (child) {
+                    parents.push_back(cur);
+                    cur = child;
+                } else {
+                    dwarf::Dwarf_Die next = raw_sibling(dbg, cur, !skipped);
+                    dbg.dealloc(cur);
+                    cur = next;
+                }
+            }
+        } catch (...) {
+            if (cur)
+                dbg.dealloc(cur);
+            for (auto& d : parents)
+                dbg.dealloc(d);
+            throw;
+        }
+    }
+
+}
+
+#endif /* !LIBDWARFPP_WALK_HH */